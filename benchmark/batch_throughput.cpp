@@ -0,0 +1,57 @@
+/*!
+ * httb.
+ * batch_throughput.cpp
+ *
+ * Measures batch_request throughput depending on number of worker threads.
+ * Run some fast local server first, for example: tests/mock/run-server.sh /path/to/tests/mock
+ * Usage: httb-bench-batch [url] [requests] [max_threads]
+ *
+ * \date 2019
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+#include <httb/httb.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+
+int main(int argc, char** argv) {
+    const std::string url = argc > 1 ? argv[1] : "http://127.0.0.1:9000/simple-server.php/get";
+    const size_t count = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100000;
+    const size_t maxThreads = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : std::max(1u, std::thread::hardware_concurrency());
+
+    std::cout << "url: " << url << "\nrequests: " << count << "\n\n";
+    std::cout << std::setw(8) << "threads" << std::setw(12) << "ok" << std::setw(12) << "failed" << std::setw(12) << "time, ms"
+              << std::setw(12) << "req/s" << std::endl;
+
+    const httb::request req(url);
+    for (size_t threads = 1; threads <= maxThreads; threads *= 2) {
+        httb::batch_request batch(static_cast<uint32_t>(threads));
+        for (size_t i = 0; i < count; i++) {
+            batch.add(req);
+        }
+
+        std::atomic<size_t> ok(0), failed(0);
+        const auto start = std::chrono::steady_clock::now();
+        batch.run_all([&ok, &failed](httb::response resp) {
+            if (resp.success()) {
+                ok++;
+            } else {
+                failed++;
+            }
+        });
+        const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        const double rps = elapsed.count() > 0 ? count * 1000.0 / elapsed.count() : 0.0;
+
+        std::cout << std::setw(8) << threads << std::setw(12) << ok << std::setw(12) << failed << std::setw(12)
+                  << elapsed.count() << std::setw(12) << static_cast<size_t>(rps) << std::endl;
+    }
+
+    return 0;
+}
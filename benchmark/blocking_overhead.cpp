@@ -0,0 +1,78 @@
+/*!
+ * httb.
+ * blocking_overhead.cpp
+ *
+ * Measures per-call cost of client::execute_blocking over keep-alive connection: time and heap allocations per request.
+ * Run some fast local server first, for example: tests/mock/run-server.sh /path/to/tests/mock
+ * Usage: httb-bench-blocking [url] [requests]
+ *
+ * \date 2019
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+#include <httb/httb.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <string>
+
+static std::atomic<size_t> allocations(0);
+
+void* operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+int main(int argc, char** argv) {
+    const std::string url = argc > 1 ? argv[1] : "http://127.0.0.1:9000/simple-server.php/get";
+    const size_t count = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 10000;
+
+    const httb::request req(url);
+    httb::client client;
+
+    // warm up: connection, dns cache, thread-local buffers
+    httb::response warm = client.execute_blocking(req);
+    if (!warm.success()) {
+        std::cerr << "Warm up request failed: " << warm.code << " " << warm.get_body() << std::endl;
+        return 1;
+    }
+
+    size_t ok = 0, failed = 0;
+    const size_t allocsBefore = allocations.load();
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; i++) {
+        httb::response resp = client.execute_blocking(req);
+        if (resp.success()) {
+            ok++;
+        } else {
+            failed++;
+        }
+    }
+    const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    const size_t allocs = allocations.load() - allocsBefore;
+    const httb::connection_stats stats = client.get_connection_stats();
+
+    std::cout << "url: " << url << "\nrequests: " << count << " (ok: " << ok << ", failed: " << failed << ")\n"
+              << "connections: " << stats.created << ", reused: " << stats.reused << "\n"
+              << std::fixed << std::setprecision(2)
+              << "time per request, us: " << static_cast<double>(elapsed.count()) / count << "\n"
+              << "allocations per request: " << static_cast<double>(allocs) / count << std::endl;
+
+    return 0;
+}
@@ -10,9 +10,11 @@
 #ifndef HTTB_BODY_H
 #define HTTB_BODY_H
 
+#include "httb/body_source.h"
 #include "httb/httb_config.h"
 #include "httb/io_container.h"
 
+#include <memory>
 #include <string>
 
 namespace httb {
@@ -21,6 +23,13 @@ class HTTB_API request_body {
 public:
     virtual ~request_body() = default;
     virtual std::string build(httb::io_container* request) const = 0;
+
+    /// \brief Build body which is read while request is being written. If not null, request uses it instead of build()
+    /// \param request
+    /// \return null by default
+    virtual std::shared_ptr<const httb::body_source> build_source(httb::io_container*) const {
+        return nullptr;
+    }
 };
 
 } // namespace httb
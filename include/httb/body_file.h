@@ -0,0 +1,43 @@
+/*!
+ * httb.
+ * body_file.h
+ *
+ * \date 2019
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+#ifndef HTTB_BODY_FILE_H
+#define HTTB_BODY_FILE_H
+
+#include "httb/body.h"
+#include "httb/httb_config.h"
+
+#include <string>
+
+namespace httb {
+
+/// \brief Raw file contents as body, like curl --data-binary @file. File is never loaded into memory:
+/// over plain HTTP it's sent with sendfile(2) (Linux), over HTTPS it's read by chunks while request is being written.
+/// File must not be changed until request is completed
+class HTTB_API body_file : public httb::request_body {
+public:
+    /// \param path file path
+    /// \param contentType Content-Type header value, empty - don't set
+    body_file(std::string path, std::string contentType = "application/octet-stream");
+    virtual ~body_file();
+
+    /// \brief Reads whole file into memory, prefer build_source()
+    std::string build(httb::io_container* request) const override;
+
+    /// \throws boost::system::system_error if file can't be opened
+    std::shared_ptr<const httb::body_source> build_source(httb::io_container* request) const override;
+
+private:
+    std::string m_path;
+    std::string m_content_type;
+};
+
+} // namespace httb
+
+#endif //HTTB_BODY_FILE_H
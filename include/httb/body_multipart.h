@@ -46,6 +46,9 @@ public:
     std::string name() const;
     std::string content_type() const;
     std::string filename() const;
+    /// \brief File path of file_path_entry
+    /// \return empty string if body is in memory
+    std::string path() const;
     bool has_body() const;
 
 private:
@@ -53,6 +56,7 @@ private:
     std::string m_name;
     std::string m_contentType = "text/plain";
     std::string m_filename;
+    std::string m_path;
     std::string m_body;
 };
 
@@ -66,6 +70,18 @@ public:
     body_multipart& add_entry(httb::multipart_entry&& entry);
     std::string build(httb::io_container* request) const override;
 };
+
+/// \brief Multipart body which is not loaded into memory: boundaries, part headers and in-memory entries are written
+/// as is, files are read by chunks while request is being written. Content-Length is calculated from file sizes.
+/// Files must not be changed until request is completed
+class HTTB_API body_multipart_stream : public httb::body_multipart {
+public:
+    /// \brief Reads whole body into memory, prefer build_source()
+    std::string build(httb::io_container* request) const override;
+
+    /// \throws boost::system::system_error if some file can't be opened
+    std::shared_ptr<const httb::body_source> build_source(httb::io_container* request) const override;
+};
 } // namespace httb
 
 #endif //HTTB_MULTIPART_HPP
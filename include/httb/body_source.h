@@ -0,0 +1,128 @@
+/*!
+ * httb.
+ * body_source.h
+ *
+ * \date 2019
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+#ifndef HTTB_BODY_SOURCE_H
+#define HTTB_BODY_SOURCE_H
+
+#include "httb/httb_config.h"
+
+#include <boost/asio/buffer.hpp>
+#include <boost/beast/http/message.hpp>
+#include <boost/optional.hpp>
+#include <boost/system/error_code.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace httb {
+
+/// \brief Sequential reader of request body, created for every write of request
+class HTTB_API body_source_reader {
+public:
+    virtual ~body_source_reader() = default;
+
+    /// \brief Get next piece of body
+    /// \param ec read error, aborts request
+    /// \return buffer valid until next call, empty buffer - end of body
+    virtual boost::asio::const_buffer next(boost::system::error_code& ec) = 0;
+};
+
+/// \brief Piece of body_source: in-memory data or file region
+struct body_segment {
+    /// \brief Segment data, if path is empty
+    std::string data;
+    /// \brief File path
+    std::string path;
+    /// \brief File region offset
+    uint64_t offset = 0;
+    /// \brief File region size
+    uint64_t size = 0;
+};
+
+/// \brief Request body produced on demand while request is being written, instead of being built in memory.
+/// Same request can be written multiple times (redirects, retries, hedges), even concurrently,
+/// so source itself must be immutable and keep read state in readers
+class HTTB_API body_source {
+public:
+    virtual ~body_source() = default;
+
+    /// \brief Size of body, if it's known before writing
+    virtual boost::optional<uint64_t> size() const = 0;
+
+    /// \brief Start reading body from beginning
+    /// \param ec open error, aborts request
+    virtual std::unique_ptr<httb::body_source_reader> open(boost::system::error_code& ec) const = 0;
+
+    /// \brief Body as list of in-memory and file segments. Over plain HTTP such body is sent without reading files
+    /// into user space (sendfile(2) on Linux)
+    /// \return null if body can't be represented by segments
+    virtual const std::vector<httb::body_segment>* segments() const {
+        return nullptr;
+    }
+};
+
+/// \brief Beast Body of outgoing request: in-memory string or body_source. Serialization only
+struct source_body {
+    struct value_type {
+        std::string data;
+        std::shared_ptr<const httb::body_source> source;
+    };
+
+    static std::uint64_t size(const value_type& body) {
+        if (body.source) {
+            return body.source->size().value_or(0);
+        }
+        return body.data.size();
+    }
+
+    class writer {
+    public:
+        using const_buffers_type = boost::asio::const_buffer;
+
+        template<bool isRequest, class Fields>
+        writer(const boost::beast::http::header<isRequest, Fields>&, const value_type& body)
+            : m_body(body) {
+        }
+
+        void init(boost::system::error_code& ec) {
+            ec = {};
+            if (m_body.source) {
+                m_reader = m_body.source->open(ec);
+            }
+        }
+
+        boost::optional<std::pair<const_buffers_type, bool>> get(boost::system::error_code& ec) {
+            ec = {};
+            if (!m_body.source) {
+                if (m_done || m_body.data.empty()) {
+                    return boost::none;
+                }
+                m_done = true;
+                return std::make_pair(const_buffers_type(m_body.data.data(), m_body.data.size()), false);
+            }
+
+            const boost::asio::const_buffer piece = m_reader->next(ec);
+            if (ec || piece.size() == 0) {
+                return boost::none;
+            }
+            return std::make_pair(piece, true);
+        }
+
+    private:
+        const value_type& m_body;
+        std::unique_ptr<httb::body_source_reader> m_reader;
+        bool m_done = false;
+    };
+};
+
+} // namespace httb
+
+#endif //HTTB_BODY_SOURCE_H
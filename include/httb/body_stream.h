@@ -0,0 +1,71 @@
+/*!
+ * httb.
+ * body_stream.h
+ *
+ * \date 2019
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+#ifndef HTTB_BODY_STREAM_H
+#define HTTB_BODY_STREAM_H
+
+#include "httb/body.h"
+#include "httb/httb_config.h"
+
+#include <boost/optional.hpp>
+#include <boost/system/error_code.hpp>
+#include <functional>
+#include <string>
+
+namespace httb {
+
+/// \brief Body generated piece by piece while request is being written, like NDJSON export, instead of being built
+/// in memory. Producer is asked for next piece only after previous one has been written to socket, so slow
+/// connection pauses producer and memory is bounded by single piece. Body of unknown size is sent
+/// with Transfer-Encoding: chunked.
+///
+/// \code
+/// req.set_body(httb::body_stream([&db]() {
+///     auto cursor = std::make_shared<db_cursor>(db.select());
+///     return [cursor](std::string& out, boost::system::error_code&) {
+///         for (size_t i = 0; i < 100 && cursor->next(); i++) {
+///             out += cursor->row_json() + "\n";
+///         }
+///         return !cursor->done();
+///     };
+/// }, "application/x-ndjson"));
+/// \endcode
+class HTTB_API body_stream : public httb::request_body {
+public:
+    /// \brief Append next piece of body to out (it's empty on call), return false if this piece is the last one.
+    /// Empty pieces are skipped. Set ec to abort request. Called on thread which writes request, must not block for long
+    using producer_func = std::function<bool(std::string& out, boost::system::error_code& ec)>;
+    /// \brief Create producer starting from beginning of body: request may be written more than once
+    /// (redirects, retries, hedges), even concurrently
+    using producer_factory_func = std::function<producer_func()>;
+
+    /// \param factory producer factory
+    /// \param contentType Content-Type header value, empty - don't set
+    /// \param size body size, if known: producer must give exactly this number of bytes.
+    /// Without size body is sent chunked
+    body_stream(producer_factory_func factory,
+                std::string contentType = "application/octet-stream",
+                boost::optional<uint64_t> size = boost::none);
+    virtual ~body_stream();
+
+    /// \brief Produces whole body in memory, prefer build_source()
+    /// \throws boost::system::system_error if producer fails
+    std::string build(httb::io_container* request) const override;
+
+    std::shared_ptr<const httb::body_source> build_source(httb::io_container* request) const override;
+
+private:
+    producer_factory_func m_factory;
+    std::string m_content_type;
+    boost::optional<uint64_t> m_size;
+};
+
+} // namespace httb
+
+#endif //HTTB_BODY_STREAM_H
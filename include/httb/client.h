@@ -24,19 +24,155 @@
 #include <chrono>
 #include <iostream>
 #include <istream>
+#include <memory>
 #include <ostream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 using namespace std::chrono_literals;
 namespace net = boost::asio;
 
+#if defined(BOOST_ASIO_HAS_CO_AWAIT)
+#define HTTB_DEFAULT_COMPLETION_TOKEN = boost::asio::use_awaitable_t<>
+#define HTTB_DEFAULT_COMPLETION_TOKEN_VALUE = CompletionToken()
+#else
+#define HTTB_DEFAULT_COMPLETION_TOKEN
+#define HTTB_DEFAULT_COMPLETION_TOKEN_VALUE
+#endif
+
 namespace httb {
 
 /// \brief Response callback (success and failed)
 using response_func_t = std::function<void(httb::response)>;
+/// \brief Streaming response headers callback: response has status and headers, but no body
+using headers_func_t = std::function<void(const httb::response&)>;
+
+class connection;
+class connection_pool;
+class tls_session_cache;
+class dns_cache;
+class concurrency_limiter;
+class batch_executor;
+class cancel_state;
+class hedge_tracker;
+class retry_tracker;
+class circuit_breaker;
+class event_loop;
+
+/// \brief Keep-alive connection pool counters
+struct connection_stats {
+    /// \brief Total opened connections
+    uint64_t created = 0;
+    /// \brief How many requests were sent over already opened connection
+    uint64_t reused = 0;
+    /// \brief How many times connection was returned to pool
+    uint64_t released = 0;
+    /// \brief Idle connections dropped by timeout, limit or closed by server
+    uint64_t expired = 0;
+    /// \brief Current idle connections count
+    size_t idle = 0;
+};
+
+/// \brief TLS handshake counters
+struct tls_stats {
+    /// \brief Handshakes with full key exchange
+    uint64_t full_handshakes = 0;
+    /// \brief Handshakes resumed by session id or ticket
+    uint64_t resumed_handshakes = 0;
+    /// \brief Current stored sessions count
+    size_t cached_sessions = 0;
+    /// \brief kTLS connections where kernel encrypts sent records
+    uint64_t ktls_send = 0;
+    /// \brief kTLS connections where kernel decrypts received records
+    uint64_t ktls_receive = 0;
+    /// \brief kTLS connections where nothing has been offloaded and OpenSSL encrypts in user space
+    uint64_t ktls_fallbacks = 0;
+};
+
+/// \brief DNS cache counters
+struct dns_stats {
+    /// \brief Lookups answered from cache or overrides
+    uint64_t hits = 0;
+    /// \brief Lookups answered with cached failure
+    uint64_t negative_hits = 0;
+    /// \brief Lookups required resolving
+    uint64_t misses = 0;
+    /// \brief Background refreshes of entries close to expiry
+    uint64_t refreshes = 0;
+    /// \brief Current cached entries count
+    size_t entries = 0;
+};
+
+/// \brief Hedged requests counters
+struct hedge_stats {
+    /// \brief Requests which could be hedged
+    uint64_t requests = 0;
+    /// \brief Hedges sent
+    uint64_t hedged = 0;
+    /// \brief Hedges which responded first
+    uint64_t hedge_wins = 0;
+    /// \brief Hedges not sent because of budget
+    uint64_t budget_exhausted = 0;
+};
+
+/// \brief Retry counters
+struct retry_stats {
+    /// \brief Retries made
+    uint64_t retries = 0;
+    /// \brief Retryable failures not retried because of host retry budget
+    uint64_t budget_exhausted = 0;
+    /// \brief Retryable failures not retried because of max retries, too long Retry-After or deadline
+    uint64_t exhausted = 0;
+};
+
+/// \brief Per-host circuit breaker state
+enum class circuit_state {
+    /// \brief Requests are sent, failures are counted
+    closed,
+    /// \brief Requests fail immediately with response::CIRCUIT_OPEN code
+    open,
+    /// \brief Few probe requests are sent, others fail immediately
+    half_open,
+};
+
+/// \brief Circuit breaker state change callback: host, port, previous state and new state.
+/// Called from thread which completed or started request, must be thread-safe
+using circuit_listener_func = std::function<void(const std::string&, uint16_t, httb::circuit_state, httb::circuit_state)>;
+
+/// \brief How to connect when host resolved to multiple addresses
+enum class connect_strategy {
+    /// \brief Try addresses one by one, next attempt starts only after previous failed
+    sequential,
+    /// \brief RFC 8305 "happy eyeballs": race ipv6 and ipv4 attempts started with small delay, first connected wins
+    happy_eyeballs,
+};
+
+/// \brief Adaptive per-host concurrency limit algorithm
+enum class limit_algorithm {
+    /// \brief No adaptive limit
+    none,
+    /// \brief Additive increase while host is busy, multiplicative decrease on errors, timeouts and 429/503/504
+    aimd,
+    /// \brief Limit follows ratio of long-term average RTT to current RTT (latency gradient)
+    gradient,
+};
+
+/// \brief When batch is done before all requests completed
+enum class completion_policy {
+    /// \brief Wait for all requests
+    all,
+    /// \brief Done on first successful response
+    first_success,
+    /// \brief Done when K requests succeeded
+    quorum,
+    /// \brief Done on first failed request (transport error or non-2xx/3xx response)
+    fail_fast,
+};
 
 class HTTB_API client_base {
+    friend class batch_executor;
+
 public:
     client_base();
     virtual ~client_base();
@@ -55,6 +191,22 @@ public:
     /// \param readSeconds
     void set_read_timeout(size_t readSeconds);
 
+    /// \brief Set connection timeout with sub-second resolution
+    /// \param timeout
+    void set_connection_timeout(std::chrono::steady_clock::duration timeout);
+
+    /// \brief Set reading timeout with sub-second resolution
+    /// \param timeout
+    void set_read_timeout(std::chrono::steady_clock::duration timeout);
+
+    /// \brief Set default time budget of whole request: DNS, connect, TLS, write, read of each redirect hop and retry.
+    /// Each phase gets remaining budget (or its own timeout, whichever is less), expired request completes
+    /// with response::DEADLINE_EXCEEDED code. Request own deadline overrides it. Blocking request with deadline runs
+    /// in event loop of calling thread, as synchronous socket operations can't be interrupted. Loop is reused by next
+    /// calls of thread, so are its pooled connections. Disabled by default
+    /// \param deadline zero - disable
+    void set_deadline(std::chrono::steady_clock::duration deadline);
+
     /// \brief Set how to react on 302 code
     /// \param followRedirects
     /// \return chain
@@ -65,14 +217,204 @@ public:
     int get_max_redirect_bounces() const;
     bool get_follow_redirects() const;
 
+    /// \brief Enable or disable reusing connections with keep-alive. Enabled by default.
+    /// Connection is reused only on io_context it was opened on: execute_blocking and async calls on each context
+    /// keep their own connections
+    /// \param enable
+    void set_keep_alive(bool enable);
+
+    /// \brief Set how long idle connection can stay in pool. Server "Keep-Alive: timeout=N" can reduce it
+    /// \param idleSeconds
+    void set_keep_alive_timeout(size_t idleSeconds);
+
+    /// \brief Set maximum idle connections per host (host, port and ssl)
+    /// \param maxPerHost
+    void set_max_idle_connections(size_t maxPerHost);
+
+    /// \brief Get keep-alive connection pool counters
+    /// \return copy of counters
+    httb::connection_stats get_connection_stats() const;
+
+    /// \brief Enable or disable TLS session resumption. Enabled by default
+    /// \param enable
+    void set_tls_session_resumption(bool enable);
+
+    /// \brief Get TLS handshake counters
+    /// \return copy of counters
+    httb::tls_stats get_tls_stats() const;
+
+    /// \brief Let Linux kernel encrypt and decrypt TLS records of new https connections (kTLS). Disabled by default.
+    /// Requires OpenSSL 3 built with kTLS and "tls" kernel module; if offload is unavailable for connection, it works
+    /// with user space encryption as usual. Offload state is reported in response::ktls and tls_stats
+    /// \param enable
+    void set_ktls(bool enable);
+
+    /// \brief Shared ssl context for all https requests of this client. Use it to load certificates or set verify mode
+    /// \return context reference
+    net::ssl::context& get_ssl_context();
+
+    /// \brief Enable or disable DNS cache. Enabled by default. Static overrides are used anyway
+    /// \param enable
+    void set_dns_cache(bool enable);
+
+    /// \brief Set how long to keep DNS lookup results. Entries are refreshed in background before expiry
+    /// \param positiveSeconds successful lookups, default 60
+    /// \param negativeSeconds failed lookups (host not found), default 5
+    void set_dns_cache_ttl(size_t positiveSeconds, size_t negativeSeconds = 5);
+
+    /// \brief Resolve host and port to given address without DNS, like curl --resolve host:port:address
+    /// Call multiple times to add multiple addresses.
+    /// \throws boost::system::system_error if address is not valid ip address
+    /// \param host
+    /// \param port
+    /// \param address ipv4 or ipv6 address
+    void add_resolve_override(const std::string& host, uint16_t port, const std::string& address);
+
+    /// \brief Drop cached DNS lookups (overrides are kept)
+    void clear_dns_cache();
+
+    /// \brief Get DNS cache counters
+    /// \return copy of counters
+    httb::dns_stats get_dns_stats() const;
+
+    /// \brief Set how to connect to host with multiple addresses. Default: sequential
+    /// \param strategy
+    /// \param attemptDelayMs for happy eyeballs: delay before starting next attempt, if previous is still connecting
+    void set_connect_strategy(httb::connect_strategy strategy, size_t attemptDelayMs = 250);
+
+    /// \brief Enable adaptive per-host concurrency limit. Each request measures RTT and errors of its host,
+    /// batch_request doesn't start more simultaneous requests to host than its current limit.
+    /// Learned limits are reset on each call
+    /// \param algorithm none - disable
+    /// \param initialLimit limit for host without samples
+    /// \param minLimit
+    /// \param maxLimit
+    void set_adaptive_concurrency(httb::limit_algorithm algorithm, size_t initialLimit = 20, size_t minLimit = 1, size_t maxLimit = 1000);
+
+    /// \brief Get current adaptive concurrency limit of host. Thread-safe, can be used for monitoring while batch is running
+    /// \param host
+    /// \param port
+    /// \return limit, or 0 if adaptive limit is disabled
+    size_t get_concurrency_limit(const std::string& host, uint16_t port) const;
+
+    /// \brief Get current adaptive concurrency limits of all hosts which have samples
+    /// \return map "host:port" -> limit
+    std::unordered_map<std::string, size_t> get_concurrency_limits() const;
+
+    /// \brief Enable hedged requests for async execution: if idempotent request has not completed within hedge delay,
+    /// the same request is sent again over other connection, first response wins and the other request is cancelled.
+    /// Requests with progress callback and blocking requests are not hedged. Disabled by default
+    /// \param enable
+    /// \param budget max share of extra requests, 0.05 - at most 5% more load
+    void set_hedging(bool enable, double budget = 0.05);
+
+    /// \brief Set fixed delay before hedge. By default delay is per-host latency percentile, see set_hedge_percentile()
+    /// \param delayMs 0 - use latency percentile
+    void set_hedge_delay(size_t delayMs);
+
+    /// \brief Set latency percentile used as hedge delay, while fixed delay is not set. Host is not hedged
+    /// until it has enough latency samples. Default: 0.95
+    /// \param percentile from 0 to 1
+    void set_hedge_percentile(double percentile);
+
+    /// \brief Get hedged requests counters
+    /// \return copy of counters
+    httb::hedge_stats get_hedge_stats() const;
+
+    /// \brief Retry failed requests. Idempotent requests are retried on connection errors (reset, timeout, unreachable)
+    /// and 429, 502, 503, 504 responses, any request - if connection was refused. Delay is exponential with
+    /// decorrelated jitter: random between base delay and 3x previous delay (3x base delay for first retry),
+    /// but not more than max delay.
+    /// Async requests and blocking ones with deadline wait on timer of event loop, other blocking requests keep pooled
+    /// connections and wait in caller's thread. Disabled by default
+    /// \param maxRetries 0 - disable
+    /// \param baseDelayMs
+    /// \param maxDelayMs
+    void set_retry(size_t maxRetries, size_t baseDelayMs = 100, size_t maxDelayMs = 10000);
+
+    /// \brief Limit retries per host (host and port): each request adds ratio of retry, so when host fails completely,
+    /// retries make at most ratio of extra load after burst is spent. Default: 0.1 and 10
+    /// \param ratio
+    /// \param burst
+    void set_retry_budget(double ratio, size_t burst = 10);
+
+    /// \brief Wait for Retry-After (seconds or HTTP-date) of response, if it's longer than backoff delay.
+    /// Response with Retry-After longer than max delay is not retried. Enabled by default
+    /// \param honor
+    void set_retry_after(bool honor);
+
+    /// \brief Get retry counters
+    /// \return copy of counters
+    httb::retry_stats get_retry_stats() const;
+
+    /// \brief Enable per-host (host and port) circuit breaker. Breaker opens when host failed (transport error or 5xx)
+    /// consecutiveFailures times in a row or failure rate of last 20 requests reached failureRate. While breaker is open,
+    /// requests fail immediately with response::CIRCUIT_OPEN code, without resolving and connecting. After openMs breaker
+    /// lets halfOpenProbes requests through, and closes if all of them succeeded. Breakers are reset on each call. Disabled by default
+    /// \param enable
+    /// \param consecutiveFailures 0 - open only by failure rate
+    /// \param failureRate from 0 to 1, 0 - open only by consecutive failures
+    /// \param openMs
+    /// \param halfOpenProbes
+    void set_circuit_breaker(bool enable, size_t consecutiveFailures = 5, double failureRate = 0.5, size_t openMs = 5000, size_t halfOpenProbes = 3);
+
+    /// \brief Set circuit breaker state change callback
+    /// \param listener
+    void set_circuit_listener(httb::circuit_listener_func listener);
+
+    /// \brief Get circuit breaker state of host
+    /// \param host
+    /// \param port
+    /// \return state, closed for unknown hosts or when breaker is disabled
+    httb::circuit_state get_circuit_state(const std::string& host, uint16_t port) const;
+
 protected:
     std::ostream* m_ostream;
     int m_max_redirect_bounces = 5;
-    net::ssl::context m_ctx;
+    std::shared_ptr<net::ssl::context> m_ctx;
+    std::shared_ptr<httb::tls_session_cache> m_tls_cache;
+    std::shared_ptr<httb::dns_cache> m_dns;
+    /// \brief Context for synchronous operations, never runs. Keeps pooled connections of execute_blocking alive,
+    /// they are not handed out to async calls
+    net::io_context m_blocking_ctx;
+    std::shared_ptr<httb::connection_pool> m_pool;
+    std::shared_ptr<httb::concurrency_limiter> m_limiter;
+    std::shared_ptr<httb::hedge_tracker> m_hedge;
+    std::shared_ptr<httb::retry_tracker> m_retry;
+    std::shared_ptr<httb::circuit_breaker> m_breaker;
+    bool m_keep_alive = true;
     bool m_follow_redirects = true;
     bool m_verbose = false;
-    std::chrono::seconds m_conn_timeout = 30s;
-    std::chrono::seconds m_read_timeout = 30s;
+    bool m_ktls = false;
+    std::chrono::steady_clock::duration m_conn_timeout = 30s;
+    std::chrono::steady_clock::duration m_read_timeout = 30s;
+    std::chrono::steady_clock::duration m_deadline = std::chrono::steady_clock::duration::zero();
+    httb::connect_strategy m_connect_strategy = httb::connect_strategy::sequential;
+    std::chrono::milliseconds m_attempt_delay = 250ms;
+};
+
+/// \brief Handle of in-flight async request. Copyable, doesn't keep request resources alive
+class HTTB_API request_handle {
+public:
+    request_handle() = default;
+    explicit request_handle(std::shared_ptr<httb::cancel_state> state);
+
+    /// \brief Abort request: stop resolver and timers, close socket. If request has not been completed yet, callback
+    /// is called with operation_aborted error (code INTERNAL_ERROR_OFFSET + operation_aborted) and no retries,
+    /// hedges or redirects are made. Thread-safe, does nothing for empty handle
+    void cancel();
+
+    /// \brief Whether cancel() has been called
+    bool cancelled() const;
+
+    /// \brief Continue reading body of streaming request, paused by chunk callback. Thread-safe
+    void resume();
+
+    /// \brief Whether handle is attached to request
+    bool valid() const;
+
+private:
+    std::shared_ptr<httb::cancel_state> m_state;
 };
 
 /// \brief Simple Http Client based on low level http library boost beast
@@ -86,29 +428,228 @@ public:
     /// \return wss::web::Response
     virtual httb::response execute_blocking(const request& request);
 
-    /// \brief ASIO-based async blocking execution using io_context
+    /// \brief ASIO-based async blocking execution using io_context.
+    /// If event loop is enabled, request is submitted to it and method returns immediately,
+    /// callbacks are called on event loop thread
     /// \param request
     /// \param cb
     virtual void execute(const request& request, const response_func_t& cb, const progress_func_t& onProgress = nullptr);
 
+    /// \brief Enable long-lived event loop threads owned by client: execute() and async_execute() without context
+    /// submit requests to them through lock-free queue, so connection pool, DNS cache and threads stay warm between calls.
+    /// Not thread-safe, call before making requests. Disabling loop stops its threads, not finished requests are dropped
+    /// \param threads number of loop threads, 0 - disable loop (default)
+    void set_event_loop(size_t threads);
+
     /// \brief ASIO-based async blocking execution using custom io_context
     /// \param ioc net::io_context
     /// \param request your request
     /// \param cb response callback
     /// \param onProgress progress callback
-    virtual void execute_in_context(net::io_context& ioc, const request& request, const response_func_t& cb, const progress_func_t& onProgress = nullptr);
+    /// \return handle to cancel request
+    virtual request_handle execute_in_context(net::io_context& ioc, const request& request, const response_func_t& cb, const progress_func_t& onProgress = nullptr);
+
+    /// \brief Execute request without buffering body: headers are passed to onHeaders first, then body is passed
+    /// to onChunk piece by piece as it's read from socket. Redirects are followed (if enabled) transparently,
+    /// but streaming requests are never retried or hedged. Read timeout applies to each chunk
+    /// \code
+    /// httb::request_handle handle = client.execute_stream(ioc, request,
+    ///     [](const httb::response& headers) { ... },
+    ///     [&](const char* data, size_t size) { queue.push(data, size); return !queue.full(); }, // false - pause
+    ///     [](httb::response resp) { ... }); // response without body or error
+    /// // later, when consumer is ready
+    /// handle.resume();
+    /// \endcode
+    /// \param ioc context to run request in
+    /// \param request your request
+    /// \param onHeaders headers callback
+    /// \param onChunk body chunk callback, data is valid only during call. Return false to pause reading until
+    /// request_handle::resume()
+    /// \param cb completion callback: response without body on success, or error
+    /// \return handle to pause or cancel request
+    request_handle execute_stream(net::io_context& ioc, const request& request, const headers_func_t& onHeaders, const chunk_func_t& onChunk,
+                                  const response_func_t& cb);
+
+    /// \brief Download response body right into file. Body is not buffered in memory: disk space is preallocated
+    /// by Content-Length (Linux) and file is written by large aligned blocks, so memory usage doesn't depend on file size.
+    /// File is created only for 2xx response, body of other responses is passed to callback as usual. If download
+    /// failed, incomplete file is removed. Like execute_stream(), download is never retried or hedged
+    /// \param ioc context to run request in
+    /// \param request your request
+    /// \param path target file, existing file is truncated
+    /// \param cb response without body on success, or error (including file errors)
+    /// \param onProgress download progress callback
+    /// \return handle to cancel request
+    request_handle download(net::io_context& ioc, const request& request, const std::string& path, const response_func_t& cb,
+                            const progress_func_t& onProgress = nullptr);
+
+    /// \brief Blocking download(), runs in private event loop
+    /// \param request your request
+    /// \param path target file, existing file is truncated
+    /// \param onProgress download progress callback
+    /// \return response without body on success, or error
+    httb::response download_blocking(const request& request, const std::string& path, const progress_func_t& onProgress = nullptr);
+
+    /// \brief Asio-style async execution: completion token decides how result is delivered.
+    /// With C++20 coroutines (BOOST_ASIO_HAS_CO_AWAIT) token defaults to use_awaitable:
+    /// \code
+    /// httb::response resp = co_await client.async_execute(ioc, request);
+    /// \endcode
+    /// Any other token works too: callback void(httb::response), boost::asio::use_future, etc.
+    /// Handler is invoked on its associated executor (ioc by default), response is moved into it.
+    /// \param ioc context to run request in
+    /// \param request your request
+    /// \param token completion token
+    template<typename CompletionToken HTTB_DEFAULT_COMPLETION_TOKEN>
+    auto async_execute(net::io_context& ioc, const request& request, CompletionToken&& token HTTB_DEFAULT_COMPLETION_TOKEN_VALUE) {
+        return net::async_initiate<CompletionToken, void(httb::response)>(
+            [this, &ioc](auto handler, const httb::request& req) {
+                using handler_t = decltype(handler);
+                auto work = net::make_work_guard(net::get_associated_executor(handler, ioc.get_executor()));
+                // completion handlers are move-only, while response callback must be copyable
+                auto op = std::make_shared<std::pair<handler_t, decltype(work)>>(std::move(handler), std::move(work));
+                execute_in_context(ioc, req, [op](httb::response resp) {
+                    auto ex = op->second.get_executor();
+                    net::dispatch(ex, [op, resp = std::move(resp)]() mutable {
+                        op->second.reset();
+                        op->first(std::move(resp));
+                    });
+                });
+            },
+            token, request);
+    }
+
+    /// \brief Same as async_execute(ioc, request, token), but request runs on client's event loop, so it must be enabled
+    /// by set_event_loop(), otherwise std::runtime_error is thrown. Plain callback and use_future complete on event loop
+    /// thread, handlers with associated executor (coroutines) - on that executor:
+    /// \code
+    /// client.set_event_loop(2);
+    /// std::future<httb::response> resp = client.async_execute(request, boost::asio::use_future);
+    /// \endcode
+    /// \param request your request
+    /// \param token completion token
+    template<typename CompletionToken HTTB_DEFAULT_COMPLETION_TOKEN>
+    auto async_execute(const request& request, CompletionToken&& token HTTB_DEFAULT_COMPLETION_TOKEN_VALUE) {
+        return net::async_initiate<CompletionToken, void(httb::response)>(
+            [this](auto handler, const httb::request& req) {
+                using handler_t = decltype(handler);
+                auto work = net::make_work_guard(net::get_associated_executor(handler));
+                auto op = std::make_shared<std::pair<handler_t, decltype(work)>>(std::move(handler), std::move(work));
+                response_func_t cb = [op](httb::response resp) {
+                    auto ex = op->second.get_executor();
+                    net::dispatch(ex, [op, resp = std::move(resp)]() mutable {
+                        op->second.reset();
+                        op->first(std::move(resp));
+                    });
+                };
+                submit(req, cb, nullptr);
+            },
+            token, request);
+    }
+
+private:
+    friend class batch_executor;
+
+    /// \brief Execute request in context, retried and hedged if applicable
+    /// \param cancel nullptr if request can't be cancelled
+    /// \param canHedge false - never hedge, blocking requests run in event loop are not hedged
+    void execute_session(net::io_context& ioc, const request& request, const response_func_t& cb, const progress_func_t& onProgress,
+                         std::shared_ptr<httb::cancel_state> cancel, bool canHedge = true);
+
+    /// \brief Execute request, hedged if applicable
+    /// \param deadline time_point::max() - no deadline
+    void execute_request(net::io_context& ioc, const request& request, const response_func_t& cb, const progress_func_t& onProgress,
+                         std::shared_ptr<httb::cancel_state> cancel, std::chrono::steady_clock::time_point deadline, bool canHedge);
+
+    /// \brief Execute request and retry it after delay on retryable failure
+    /// \param attempt number of retries already made
+    /// \param delay previous retry delay
+    void execute_retry(net::io_context& ioc, const request& request, const response_func_t& cb, const progress_func_t& onProgress,
+                       std::shared_ptr<httb::cancel_state> cancel, std::chrono::steady_clock::time_point deadline,
+                       size_t attempt, std::chrono::milliseconds delay, bool canHedge);
+
+    /// \brief Single blocking request without retries
+    httb::response execute_blocking_once(const request& request);
+
+    /// \brief Absolute deadline of request started now: request deadline or client default
+    std::chrono::steady_clock::time_point make_deadline(const request& request) const;
+
+    /// \brief Execute single attempt of request, every session (including redirects) is attached to cancel state
+    /// \param onChunk not null - stream response body
+    void execute_attempt(net::io_context& ioc, const request& request, const response_func_t& cb, const progress_func_t& onProgress,
+                         std::shared_ptr<httb::cancel_state> cancel, std::chrono::steady_clock::time_point deadline,
+                         const headers_func_t& onHeaders = nullptr, const chunk_func_t& onChunk = nullptr);
+
+    /// \brief Execute request and its hedge after delay
+    void execute_hedged(net::io_context& ioc, const request& request, const response_func_t& cb,
+                        std::shared_ptr<httb::cancel_state> cancel, std::chrono::steady_clock::time_point deadline,
+                        std::chrono::steady_clock::duration delay);
+    /// \brief Submit request to event loop
+    void submit(const request& request, const response_func_t& cb, const progress_func_t& onProgress);
+
+    /// \brief Resolve, connect and handshake (if ssl) new connection in blocking context
+    std::unique_ptr<httb::connection> open_blocking(const request& request, boost::system::error_code& ec);
+
+    std::unique_ptr<httb::event_loop> m_loop;
+};
+
+/// \brief Batch request result: response and request it belongs to
+struct batch_result {
+    httb::request request;
+    httb::response response;
 };
 
 class HTTB_API batch_request {
 public:
     /// \brief Each request result callback
     using on_response_each_func = httb::response_func_t;
-    /// \brief All passed request result callback
+    /// \brief All passed request result callback, responses are in submission order
     using on_response_all_func = std::function<void(std::vector<response>)>;
+    /// \brief All passed request result callback, results are in submission order
+    using on_result_all_func = std::function<void(std::vector<httb::batch_result>)>;
+    /// \brief Lazy request source: fill request and return true, or return false if there are no more requests.
+    /// Called from worker threads, but never concurrently
+    using request_source_func = std::function<bool(httb::request&)>;
+
+    /// \brief Default limit of simultaneously executing requests
+    static const size_t DEFAULT_MAX_IN_FLIGHT = 1024;
 
     batch_request();
+
+    /// \brief
+    /// \param concurrency number of worker threads, each one runs own io_context
     batch_request(uint32_t concurrency);
 
+    /// \brief Allow idle worker to take not yet started requests of other workers. Default: enabled
+    /// \param enabled
+    void set_work_stealing(bool enabled);
+
+    /// \brief Limit number of simultaneously executing requests (open sessions and sockets).
+    /// Next request starts only when one of previous completes. Default: DEFAULT_MAX_IN_FLIGHT
+    /// \param maxInFlight 0 - unlimited
+    void set_max_in_flight(size_t maxInFlight);
+
+    /// \brief Limit number of simultaneously executing requests to the same host and port.
+    /// Requests of different hosts are started round-robin, so slow host can't occupy whole window. Default: unlimited
+    /// \param maxInFlightPerHost 0 - unlimited
+    void set_max_in_flight_per_host(size_t maxInFlightPerHost);
+
+    /// \brief Finish batch early: when policy is satisfied, requests not yet started are not pulled from source,
+    /// queued ones are not started, and in-flight ones are cancelled (their sockets are closed). Cancelled requests
+    /// complete with operation_aborted error response. Default: completion_policy::all
+    /// \param policy
+    /// \param quorum number of successful responses for completion_policy::quorum
+    void set_completion_policy(httb::completion_policy policy, size_t quorum = 1);
+
+    /// \brief Set lazy request source. Requests are pulled only when there is free room in the in-flight window,
+    /// so memory doesn't depend on batch size. Source is pulled after all requests added by add(), and is consumed by run_all()
+    /// \param source generator
+    void set_source(request_source_func source);
+
+    /// \brief Client that executes requests, use it to configure timeouts, keep-alive, adaptive concurrency etc.
+    /// \return client reference
+    httb::client& get_client();
+
     /// \brief Add request to queue (move ctor)
     /// \param req movable request
     /// \return self
@@ -119,14 +660,30 @@ public:
     /// \return self
     const httb::batch_request& add(const httb::request& req);
 
+    /// \brief Execute all requests on worker threads and wait for completion
+    /// \param cb called for each response, calls are serialized, but may come from different threads
     void run_all(const on_response_each_func& cb);
+
+    /// \brief Execute all requests on worker threads and wait for completion
+    /// \param cb called once with all responses, i-th response belongs to i-th submitted request
     void run_all(const on_response_all_func& cb);
 
+    /// \brief Execute all requests on worker threads and wait for completion
+    /// \param cb called once with all results (request and its response) in submission order
+    void run_all(const on_result_all_func& cb);
+
 private:
     uint32_t m_concurrency;
-    httb::context m_ctx;
+    bool m_work_stealing = true;
+    size_t m_max_in_flight = DEFAULT_MAX_IN_FLIGHT;
+    size_t m_max_in_flight_per_host = 0;
+    httb::completion_policy m_policy = httb::completion_policy::all;
+    size_t m_quorum = 1;
     httb::client m_client;
     std::deque<httb::request> m_requests;
+    request_source_func m_source;
+
+    request_source_func make_source();
 };
 
 } // namespace httb
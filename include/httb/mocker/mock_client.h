@@ -49,7 +49,7 @@ public:
 
         ctx.run();
     }
-    void execute_in_context(net::io_context& ioc, const request& request, const response_func_t& cb, const progress_func_t& onProgress = nullptr) override {
+    request_handle execute_in_context(net::io_context& ioc, const request& request, const response_func_t& cb, const progress_func_t& onProgress = nullptr) override {
         if (!m_executor) {
             throw std::runtime_error("Mock executor did not set.");
         }
@@ -63,6 +63,7 @@ public:
         });
 
         ioc.run();
+        return request_handle();
     }
 
 protected:
@@ -11,8 +11,10 @@
 #define HTTB_REQUEST_H
 
 #include "httb/body.h"
+#include "httb/body_file.h"
 #include "httb/body_form_urlencoded.h"
 #include "httb/body_multipart.h"
+#include "httb/body_stream.h"
 #include "httb/body_string.h"
 #include "httb/io_container.h"
 
@@ -21,6 +23,7 @@
 #include <boost/beast/http.hpp>
 #include <boost/beast/version.hpp>
 #include <boost/optional.hpp>
+#include <chrono>
 #include <memory>
 #include <queue>
 #include <sstream>
@@ -115,6 +118,21 @@ public:
     /// \return string method name, ie GET, POST, etc
     std::string get_method_str() const;
 
+    /// \brief Whether request method is idempotent (RFC 7231): GET, HEAD, OPTIONS, TRACE, PUT, DELETE.
+    /// Such request can be safely sent more than once
+    /// \return true if idempotent
+    bool is_idempotent() const;
+
+    /// \brief Set time budget of whole request: DNS, connect, TLS, write, read of each redirect hop and retry.
+    /// Each phase gets remaining budget, expired request completes with response::DEADLINE_EXCEEDED code.
+    /// Overrides client deadline
+    /// \param deadline zero - use client deadline
+    void set_deadline(std::chrono::steady_clock::duration deadline);
+
+    /// \brief Get time budget of request
+    /// \return zero if not set
+    std::chrono::steady_clock::duration get_deadline() const;
+
     /// \brief Whether call will be with requested with ssl stream or not
     /// \return true if ssl is used
     bool is_ssl() const;
@@ -222,6 +240,7 @@ private:
     std::string m_path;
     /// \brief like multimap but vector of pairs
     kv_vector m_params;
+    std::chrono::steady_clock::duration m_deadline = std::chrono::steady_clock::duration::zero();
 };
 
 class HTTB_API request : public httb::base_request {
@@ -239,12 +258,24 @@ public:
         : base_request(url, method) {
     }
 
-    [[nodiscard]] boost::beast::http::request<boost::beast::http::string_body> to_beast_request() const;
+    [[nodiscard]] boost::beast::http::request<httb::request_body_type> to_beast_request() const;
 
     void set_body(const std::string& body) override;
     void set_body(std::string&& body) override;
     void set_body(const httb::request_body& body);
     void set_body(httb::request_body&& body);
+
+    /// \brief Set body which is read while request is being written, instead of being kept in memory.
+    /// Sets Content-Length header if source size is known
+    /// \param source
+    void set_body_source(std::shared_ptr<const httb::body_source> source);
+    std::shared_ptr<const httb::body_source> get_body_source() const;
+
+    bool has_body() const override;
+    void clear_body() override;
+
+private:
+    std::shared_ptr<const httb::body_source> m_body_source;
 };
 
 } // namespace httb
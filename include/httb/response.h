@@ -14,6 +14,7 @@
 #include "types.h"
 
 #include <boost/beast/http/status.hpp>
+#include <sstream>
 #include <string>
 
 namespace httb {
@@ -21,10 +22,19 @@ namespace httb {
 class HTTB_API response : public httb::io_container {
 public:
     static const int INTERNAL_ERROR_OFFSET = 1000;
+    /// \brief Request was not sent: circuit breaker of its host is open. Values above INTERNAL_ERROR_OFFSET + 2000
+    /// are httb own errors, they don't intersect with system error codes
+    static const int CIRCUIT_OPEN = INTERNAL_ERROR_OFFSET + 2000;
+    /// \brief Request deadline expired
+    static const int DEADLINE_EXCEEDED = INTERNAL_ERROR_OFFSET + 2001;
     friend class client;
     using http_status = boost::beast::http::status;
 
     response();
+    response(const response&) = default;
+    response(response&&) noexcept = default;
+    response& operator=(const response&) = default;
+    response& operator=(response&&) noexcept = default;
     virtual ~response() = default;
 
     /// \brief Return map of POST body form-url-encoded data
@@ -64,6 +74,10 @@ public:
 
     std::string status_message;
     std::string data;
+    /// \brief Kernel TLS offload state of connection response has been received over, see client_base::set_ktls()
+    httb::ktls_status ktls;
+    /// \brief Request failed with transport error which may be repeated, see client_base::set_retry()
+    bool retryable = false;
 };
 
 } // namespace httb
@@ -10,8 +10,9 @@
 #ifndef HTTB_TYPES_H
 #define HTTB_TYPES_H
 
+#include "httb/body_source.h"
+
 #include <boost/asio/io_context.hpp>
-#include <boost/beast/http/dynamic_body.hpp>
 #include <boost/beast/http/file_body.hpp>
 #include <boost/beast/http/message.hpp>
 #include <boost/beast/http/string_body.hpp>
@@ -22,8 +23,10 @@
 
 namespace httb {
 
-using request_body_type = boost::beast::http::string_body;
-using response_body_type = boost::beast::http::dynamic_body;
+/// \brief Request body is either string or body_source, read while request is being written
+using request_body_type = httb::source_body;
+/// \brief Parser writes body into contiguous string reserved by Content-Length, it's moved to response then
+using response_body_type = boost::beast::http::string_body;
 using response_file_body_type = boost::beast::http::file_body;
 using response_t = boost::beast::http::response<httb::response_body_type>;
 using context = boost::asio::io_context;
@@ -33,6 +36,17 @@ using error_func_t = std::function<void(boost::system::error_code, std::string)>
 using success_func_t = std::function<void(httb::response_t&&, size_t)>;
 /// \brief Progress callback
 using progress_func_t = std::function<void(uint64_t, uint64_t, double)>;
+/// \brief Streaming response body chunk callback: data is valid only during call.
+/// Return false to pause reading until request_handle::resume()
+using chunk_func_t = std::function<bool(const char*, size_t)>;
+
+/// \brief Kernel TLS offload state of connection
+struct ktls_status {
+    /// \brief Kernel encrypts sent records
+    bool send = false;
+    /// \brief Kernel decrypts received records
+    bool receive = false;
+};
 
 /// \brief Simple std::pair<std::string, std::string>
 using kv = std::pair<std::string, std::string>;
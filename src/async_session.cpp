@@ -9,101 +9,314 @@
 
 #include "async_session.h"
 
+#include "zero_copy_writer.h"
+
 #include <utility>
 
-httb::async_session::async_session(boost::asio::io_context& ctx, httb::request request, std::chrono::seconds conn_tout, std::chrono::seconds read_tout)
-    : m_strand(ctx),
-      m_ssl_ctx(net::ssl::context::tlsv12),
+/// \brief Streaming mode read buffer size
+static const size_t STREAM_CHUNK_SIZE = 64 * 1024;
+
+void httb::cancel_state::cancel() {
+    std::shared_ptr<httb::async_session> session;
+    std::vector<std::weak_ptr<httb::cancel_state>> children;
+    std::function<void()> handler;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_cancelled = true;
+        session = m_session.lock();
+        children.swap(m_children);
+        handler.swap(m_handler);
+    }
+    if (session) {
+        session->cancel();
+    }
+    if (handler) {
+        handler();
+    }
+    for (auto& child : children) {
+        if (auto state = child.lock()) {
+            state->cancel();
+        }
+    }
+}
+
+void httb::cancel_state::link(const std::shared_ptr<httb::cancel_state>& child) {
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (!m_cancelled) {
+            m_children.push_back(child);
+            return;
+        }
+    }
+    child->cancel();
+}
+
+void httb::cancel_state::on_cancel(std::function<void()> handler) {
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (!m_cancelled) {
+            m_handler = std::move(handler);
+            return;
+        }
+    }
+    if (handler) {
+        handler();
+    }
+}
+
+void httb::cancel_state::resume() {
+    std::shared_ptr<httb::async_session> session;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        session = m_session.lock();
+    }
+    if (session) {
+        session->resume();
+    }
+}
+
+bool httb::cancel_state::cancelled() const {
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_cancelled;
+}
+
+void httb::cancel_state::attach(const std::shared_ptr<httb::async_session>& session) {
+    bool cancelled;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_session = session;
+        cancelled = m_cancelled;
+    }
+    if (cancelled) {
+        session->cancel();
+    }
+}
+
+httb::async_session::async_session(boost::asio::io_context& ctx,
+                                   httb::request request,
+                                   std::chrono::steady_clock::duration conn_tout,
+                                   std::chrono::steady_clock::duration read_tout)
+    : m_ioc(ctx),
+      m_strand(ctx),
       m_resolver(m_strand),
-      m_stream_raw(nullptr),
-      m_stream_ssl(nullptr),
       m_request_raw(std::move(request)),
       m_request(m_request_raw.to_beast_request()),
       m_conn_timeout(conn_tout),
-      m_read_timeout(read_tout) {
+      m_read_timeout(read_tout),
+      m_deadline_timer(m_strand) {
 
     m_response.body_limit(std::numeric_limits<std::uint64_t>::max());
+}
+httb::async_session::~async_session() {
+}
 
+void httb::async_session::open_connection() {
+    m_reused = false;
     if (m_request_raw.is_ssl()) {
-        m_stream_ssl = new beast::ssl_stream<beast::tcp_stream>(m_strand, m_ssl_ctx);
+        if (!m_tls_cache) {
+            m_tls_cache = std::make_shared<httb::tls_session_cache>(std::make_shared<ssl::context>(net::ssl::context::tlsv12));
+        }
+        auto sslCtx = m_tls_cache->context();
+        m_conn = std::make_unique<httb::connection>(m_ioc, m_ioc.get_executor(), *sslCtx, m_request_raw.get_host(), m_request_raw.get_port(), m_ktls);
+        m_conn->hold_ssl_context(sslCtx);
     } else {
-        m_stream_raw = new beast::tcp_stream(m_strand);
+        m_conn = std::make_unique<httb::connection>(m_ioc, m_ioc.get_executor(), m_request_raw.get_host(), m_request_raw.get_port());
+    }
+
+    if (m_pool) {
+        m_pool->on_created();
     }
 }
-httb::async_session::~async_session() {
-    delete m_stream_ssl;
-    delete m_stream_raw;
+
+void httb::async_session::write_request() {
+    m_conn->expires_never();
+    if (httb::zero_copy_writer::supported(m_request, !m_conn->plain_writes())) {
+        v("write", "Sending file body with sendfile");
+        auto writer = std::make_shared<httb::zero_copy_writer>(m_conn->tcp().socket(), m_request);
+        writer->async_write(m_strand,
+                            std::bind(&async_session::on_write,
+                                      shared_from_this(),
+                                      std::placeholders::_1,
+                                      std::placeholders::_2));
+        return;
+    }
+    with_stream([this](auto& stream) {
+        http::async_write(stream, m_request,
+                          net::bind_executor(m_strand,
+                                             std::bind(&async_session::on_write,
+                                                       shared_from_this(),
+                                                       std::placeholders::_1,
+                                                       std::placeholders::_2)));
+    });
 }
 
 void httb::async_session::read_response() {
-    if (m_request_raw.is_ssl()) {
-        read_response_ssl();
-    } else {
-        read_response_plain();
+    if (m_chunk_func) {
+        read_stream_header();
+        return;
     }
+    with_stream([this](auto& stream) {
+        if (m_progress_func) {
+            http::async_read_some(stream, m_buffer, m_response,
+                                  net::bind_executor(m_strand,
+                                                     std::bind(&async_session::on_read,
+                                                               shared_from_this(),
+                                                               std::placeholders::_1,
+                                                               std::placeholders::_2)));
+        } else {
+            // read full content is no progress callback set
+            http::async_read(stream, m_buffer, m_response,
+                             net::bind_executor(m_strand,
+                                                std::bind(&async_session::on_read,
+                                                          shared_from_this(),
+                                                          std::placeholders::_1,
+                                                          std::placeholders::_2)));
+        }
+    });
 }
 
-void httb::async_session::read_response_ssl() {
-    if (m_progress_func) {
-        http::async_read_some(*m_stream_ssl, m_buffer, m_response,
-                              std::bind(&async_session::on_read,
-                                        shared_from_this(),
-                                        std::placeholders::_1,
-                                        std::placeholders::_2));
-    } else {
-        // read full content is no progress callback set
-        http::async_read(*m_stream_ssl, m_buffer, m_response,
-                         std::bind(&async_session::on_read,
-                                   shared_from_this(),
-                                   std::placeholders::_1,
-                                   std::placeholders::_2));
-    }
-}
-
-void httb::async_session::read_response_plain() {
-    if (m_progress_func) {
-        http::async_read_some(*m_stream_raw, m_buffer, m_response,
-                              std::bind(&async_session::on_read,
-                                        shared_from_this(),
-                                        std::placeholders::_1,
-                                        std::placeholders::_2));
-    } else {
-        http::async_read(*m_stream_raw, m_buffer, m_response,
-                         std::bind(&async_session::on_read,
-                                   shared_from_this(),
-                                   std::placeholders::_1,
-                                   std::placeholders::_2));
+void httb::async_session::read_stream_header() {
+    m_stream_response.emplace();
+    m_stream_response->body_limit(std::numeric_limits<std::uint64_t>::max());
+    with_stream([this](auto& stream) {
+        http::async_read_header(stream, m_buffer, *m_stream_response,
+                                net::bind_executor(m_strand,
+                                                   std::bind(&async_session::on_stream_header,
+                                                             shared_from_this(),
+                                                             std::placeholders::_1,
+                                                             std::placeholders::_2)));
+    });
+}
+
+void httb::async_session::read_stream_body() {
+    if (m_stream_response->is_done()) {
+        // empty body
+        complete(httb::response_t(std::move(m_stream_response->release().base())), 0);
+        return;
+    }
+    if (!m_chunk) {
+        m_chunk = std::make_unique<char[]>(STREAM_CHUNK_SIZE);
+    }
+    m_stream_response->get().body().data = m_chunk.get();
+    m_stream_response->get().body().size = STREAM_CHUNK_SIZE;
+    // read timeout is idle timeout here: body may stream for a long time
+    m_conn->expires_after(phase_timeout(m_read_timeout));
+    with_stream([this](auto& stream) {
+        http::async_read(stream, m_buffer, *m_stream_response,
+                         net::bind_executor(m_strand,
+                                            std::bind(&async_session::on_stream_body,
+                                                      shared_from_this(),
+                                                      std::placeholders::_1,
+                                                      std::placeholders::_2)));
+    });
+}
+
+bool httb::async_session::retry_stale(boost::system::error_code ec, bool written) {
+    const bool gotSome = m_chunk_func ? m_stream_response && m_stream_response->got_some() : m_response.got_some();
+    if (!m_reused || gotSome) {
+        return false;
     }
+    if (written && !m_request_raw.is_idempotent()) {
+        // server may have processed request before closing connection, sending it again is not safe
+        return false;
+    }
+
+    // server closed idle connection right before we sent request, repeat over new connection
+    v("retry", "Idle connection has been closed (" + ec.message() + "), reconnecting...");
+    m_conn.reset();
+    m_reused = false;
+    m_buffer.consume(m_buffer.size());
+    resolve();
+    return true;
 }
 
 void httb::async_session::run(httb::error_func_t onError, httb::success_func_t onSuccess) {
     m_error_func = std::move(onError);
     m_success_func = std::move(onSuccess);
 
+    if (m_deadline != std::chrono::steady_clock::time_point::max()) {
+        m_deadline_timer.expires_at(m_deadline);
+        m_deadline_timer.async_wait(std::bind(&async_session::on_deadline, shared_from_this(), std::placeholders::_1));
+    }
+
+    if (m_pool) {
+        m_conn = m_pool->acquire(m_ioc, m_request_raw.get_host(), m_request_raw.get_port(), m_request_raw.is_ssl());
+    }
+
+    if (m_conn) {
+        m_reused = true;
+        m_ktls_status = m_conn->ktls_status();
+        v("run", "Reusing connection to host " + m_request_raw.get_host());
+        write_request();
+        return;
+    }
+
+    resolve();
+}
+
+void httb::async_session::resolve() {
     v("run", "Resolve host " + m_request_raw.get_host());
 
-    m_resolver.async_resolve(m_request_raw.get_host(), m_request_raw.get_port_str().c_str(),
+    if (m_dns) {
+        m_resolving = true;
+        m_dns->async_resolve(m_strand, m_request_raw.get_host(), m_request_raw.get_port_str(),
                              std::bind(&async_session::on_resolve,
                                        shared_from_this(),
                                        std::placeholders::_1,
                                        std::placeholders::_2));
+        return;
+    }
+
+    auto self = shared_from_this();
+    m_resolver.async_resolve(m_request_raw.get_host(), m_request_raw.get_port_str().c_str(),
+                             [self](boost::system::error_code ec, tcp::resolver::results_type results) {
+                                 httb::endpoints_t endpoints;
+                                 for (const auto& entry : results) {
+                                     endpoints.push_back(entry.endpoint());
+                                 }
+                                 self->on_resolve(ec, endpoints);
+                             });
 }
 
-void httb::async_session::on_resolve(boost::system::error_code ec,
-                                     net::ip::basic_resolver<net::ip::tcp, net::executor>::results_type results) {
+void httb::async_session::on_resolve(boost::system::error_code ec, const httb::endpoints_t& endpoints) {
+    m_resolving = false;
+    if (fail_if_cancelled()) {
+        return;
+    }
     if (ec && !is_ignored_error(ec)) {
         fail(ec, "resolve");
         return;
     }
 
-    stream()->expires_after(std::chrono::seconds(m_conn_timeout));
+    open_connection();
+
+    if (m_connect_strategy == httb::connect_strategy::happy_eyeballs && endpoints.size() > 1) {
+        v("on_resolved", "Racing connections to host...");
+        auto self = shared_from_this();
+        m_connector = std::make_shared<httb::happy_eyeballs_connector>(m_strand, endpoints, m_attempt_delay, phase_timeout(m_conn_timeout));
+        m_connector->run([self](boost::system::error_code ec, httb::happy_eyeballs_connector::socket_t& socket) {
+            self->m_connector.reset();
+            if (!ec) {
+                self->stream()->socket() = std::move(socket);
+            }
+            self->on_connect(ec);
+        });
+        return;
+    }
+
+    stream()->expires_after(phase_timeout(m_conn_timeout));
 
     v("on_resolved", "Connecting to host...");
-    stream()->async_connect(results.begin(), results.end(),
-                            std::bind(&async_session::on_connect, shared_from_this(), std::placeholders::_1));
+    // endpoints must live until connect completes
+    m_endpoints = endpoints;
+    stream()->async_connect(m_endpoints.begin(), m_endpoints.end(),
+                            net::bind_executor(m_strand, std::bind(&async_session::on_connect, shared_from_this(), std::placeholders::_1)));
 }
 
 void httb::async_session::on_connect(boost::system::error_code ec) {
+    if (fail_if_cancelled()) {
+        return;
+    }
     if (ec && !is_ignored_error(ec)) {
         fail(ec, "connect");
         return;
@@ -123,63 +336,90 @@ void httb::async_session::on_connect(boost::system::error_code ec) {
 
     if (m_request_raw.is_ssl()) {
         v("on_connected", "Handshaking...");
-        m_stream_ssl->async_handshake(ssl::stream_base::client,
-                                      std::bind(&async_session::on_ssl_handshake,
-                                                shared_from_this(),
-                                                std::placeholders::_1));
+        if (!m_tls_cache->prepare(m_conn->ssl_handle(), m_conn->key(), m_request_raw.get_host())) {
+            fail({static_cast<int>(::ERR_get_error()), net::error::get_ssl_category()}, "handshake");
+            return;
+        }
+        if (m_conn->is_ktls()) {
+            m_conn->ktls().expires_after(phase_timeout(m_conn_timeout));
+            m_conn->ktls().async_handshake(net::bind_executor(m_strand,
+                                                              std::bind(&async_session::on_ssl_handshake,
+                                                                        shared_from_this(),
+                                                                        std::placeholders::_1)));
+            return;
+        }
+        m_conn->ssl().async_handshake(ssl::stream_base::client,
+                                      net::bind_executor(m_strand,
+                                                         std::bind(&async_session::on_ssl_handshake,
+                                                                   shared_from_this(),
+                                                                   std::placeholders::_1)));
         return;
     }
 
-    stream()->expires_never();
-    http::async_write(*stream(), m_request,
-                      std::bind(&async_session::on_write,
-                                shared_from_this(),
-                                std::placeholders::_1,
-                                std::placeholders::_2));
+    write_request();
 }
 
 void httb::async_session::on_ssl_handshake(boost::system::error_code ec) {
+    if (fail_if_cancelled()) {
+        return;
+    }
     if (ec && !is_ignored_error(ec)) {
         fail(ec, "handshake");
         return;
     }
 
-    stream()->expires_never();
-    http::async_write(*m_stream_ssl, m_request,
-                      std::bind(&async_session::on_write,
-                                shared_from_this(),
-                                std::placeholders::_1,
-                                std::placeholders::_2));
+    m_tls_cache->on_handshake(m_conn->ssl_handle());
+    if (m_conn->is_ktls()) {
+        m_ktls_status = m_conn->ktls_status();
+        m_tls_cache->on_ktls(m_ktls_status);
+        v("on_ssl_handshake", std::string("Kernel TLS offload: send ") + (m_ktls_status.send ? "on" : "off") +
+                                  ", receive " + (m_ktls_status.receive ? "on" : "off"));
+    }
+    write_request();
 }
 
 void httb::async_session::on_write(boost::system::error_code ec, std::size_t) {
+    if (fail_if_cancelled()) {
+        return;
+    }
+    if (ec && retry_stale(ec, false)) {
+        return;
+    }
     if (ec && !is_ignored_error(ec)) {
         fail(ec, "write");
         return;
     }
 
     v("on_write", "Read response...");
-    stream()->expires_after(m_read_timeout);
+    m_conn->expires_after(phase_timeout(m_read_timeout));
     read_response();
 }
 
 void httb::async_session::on_read(boost::system::error_code ec, std::size_t bytesTransferred) {
+    if (fail_if_cancelled()) {
+        return;
+    }
+    if (ec && retry_stale(ec, true)) {
+        return;
+    }
     if (ec && !is_ignored_error(ec)) {
         fail(ec, "read");
         return;
     }
-
-    if (m_response.is_done()) {
-        v("on_read", "Shutting down");
-
-        // Don't shutdown ssl stream - it's bad idea, you will get inifinite waiting for server closing ssl. Close socket directly with no worries
-        stream()->socket().shutdown(tcp::socket::shutdown_both, ec);
-
-        if (ec && !is_ignored_error(ec) && ec != boost::system::errc::not_connected) {
-            fail(ec, "shutdown");
+    if (ec && !m_response.is_done()) {
+        // body without length ends with connection close (ssl stream may be truncated without close_notify)
+        boost::system::error_code eofEc;
+        if (m_response.is_header_done() && m_response.need_eof()) {
+            m_response.put_eof(eofEc);
+        }
+        if (!m_response.is_done() || eofEc) {
+            // eof in the middle of message, reading again will give the same result
+            fail(ec, "read");
             return;
         }
+    }
 
+    if (m_response.is_done()) {
         if (m_progress_func) {
             uint64_t total_len = m_response.content_length().value_or(0ULL);
             if (total_len == 0) {
@@ -189,10 +429,7 @@ void httb::async_session::on_read(boost::system::error_code ec, std::size_t byte
             }
         }
 
-        if (m_success_func) {
-            m_success_func(m_response.release(), bytesTransferred);
-        }
-        // here everything gracefully closed
+        complete(m_response.release(), bytesTransferred);
     } else {
         if (m_progress_func) {
             uint64_t total_len = m_response.content_length().value_or(0ULL);
@@ -210,6 +447,105 @@ void httb::async_session::on_read(boost::system::error_code ec, std::size_t byte
     }
 }
 
+void httb::async_session::on_stream_header(boost::system::error_code ec, std::size_t) {
+    if (fail_if_cancelled()) {
+        return;
+    }
+    if (ec && retry_stale(ec, true)) {
+        return;
+    }
+    if (ec) {
+        fail(ec, "read");
+        return;
+    }
+
+    if (m_headers_func) {
+        m_headers_func(m_stream_response->get().base());
+    }
+    read_stream_body();
+}
+
+void httb::async_session::on_stream_body(boost::system::error_code ec, std::size_t bytesTransferred) {
+    if (fail_if_cancelled()) {
+        return;
+    }
+    if (ec == http::error::need_buffer) {
+        // chunk buffer is full
+        ec = {};
+    }
+    if (ec && !is_ignored_error(ec)) {
+        fail(ec, "read");
+        return;
+    }
+    if (ec && !m_stream_response->is_done()) {
+        boost::system::error_code eofEc;
+        if (m_stream_response->need_eof()) {
+            m_stream_response->put_eof(eofEc);
+        }
+        if (!m_stream_response->is_done() || eofEc) {
+            fail(ec, "read");
+            return;
+        }
+    }
+
+    const size_t size = STREAM_CHUNK_SIZE - m_stream_response->get().body().size;
+    bool more = true;
+    if (size > 0) {
+        more = m_chunk_func(m_chunk.get(), size);
+    }
+
+    if (m_stream_response->is_done()) {
+        // body has been already passed to callback
+        complete(httb::response_t(std::move(m_stream_response->release().base())), bytesTransferred);
+        return;
+    }
+    if (!more) {
+        v("on_read", "Stream paused");
+        m_paused = true;
+        m_paused_self = shared_from_this();
+        m_paused_work.emplace(m_ioc.get_executor());
+        return;
+    }
+    read_stream_body();
+}
+
+void httb::async_session::complete(httb::response_t&& result, size_t bytesTransferred) {
+    const bool keep_alive = m_request.keep_alive() && !result.need_eof();
+
+    if (m_pool && keep_alive) {
+        v("on_read", "Returning connection to pool");
+        m_conn->expires_never();
+        m_pool->release(std::move(m_conn), keep_alive, result);
+    } else {
+        v("on_read", "Shutting down");
+        m_conn->close();
+    }
+
+    m_finished = true;
+    m_deadline_timer.cancel();
+    if (m_success_func) {
+        m_success_func(std::move(result), bytesTransferred);
+    }
+    // here everything gracefully closed
+}
+
+void httb::async_session::set_stream(std::function<void(const http::response_header<>&)> on_headers, httb::chunk_func_t on_chunk) {
+    m_headers_func = std::move(on_headers);
+    m_chunk_func = std::move(on_chunk);
+}
+
+void httb::async_session::resume() {
+    auto self = shared_from_this();
+    net::post(m_strand, [self]() {
+        if (!self->m_paused || self->m_finished) {
+            return;
+        }
+        self->v("resume", "Stream resumed");
+        self->unpause();
+        self->read_stream_body();
+    });
+}
+
 void httb::async_session::set_verbose(bool verbose) {
     m_verbose = verbose;
 }
@@ -218,11 +554,112 @@ void httb::async_session::set_on_progress_cb(httb::progress_func_t progress) {
     m_progress_func = progress;
 }
 
+void httb::async_session::set_connection_pool(std::shared_ptr<httb::connection_pool> pool) {
+    m_pool = std::move(pool);
+}
+
+void httb::async_session::set_tls_session_cache(std::shared_ptr<httb::tls_session_cache> cache) {
+    m_tls_cache = std::move(cache);
+}
+
+void httb::async_session::set_ktls(bool enabled) {
+    m_ktls = enabled;
+}
+
+httb::ktls_status httb::async_session::get_ktls_status() const {
+    return m_ktls_status;
+}
+
+void httb::async_session::set_dns_cache(std::shared_ptr<httb::dns_cache> dns) {
+    m_dns = std::move(dns);
+}
+
+void httb::async_session::set_deadline(std::chrono::steady_clock::time_point deadline) {
+    m_deadline = deadline;
+}
+
+void httb::async_session::set_connect_strategy(httb::connect_strategy strategy, std::chrono::milliseconds attempt_delay) {
+    m_connect_strategy = strategy;
+    m_attempt_delay = attempt_delay;
+}
+
 bool httb::async_session::is_ignored_error(boost::system::error_code ec) {
     return std::find(m_ignored_errors.begin(), m_ignored_errors.end(), ec) != m_ignored_errors.end();
 }
 
+void httb::async_session::cancel() {
+    auto self = shared_from_this();
+    net::post(m_strand, [self]() {
+        if (self->m_cancelled || self->m_finished) {
+            return;
+        }
+        self->v("cancel", "Cancelling request");
+        self->m_cancelled = true;
+        self->abort();
+    });
+}
+
+void httb::async_session::abort() {
+    // pending handlers complete with operation_aborted, connection is not returned to pool
+    m_resolver.cancel();
+    if (m_connector) {
+        // connector handler resets m_connector
+        auto connector = m_connector;
+        connector->cancel();
+    }
+    if (m_conn) {
+        stream()->close();
+    }
+    if (m_resolving || m_paused) {
+        // shared lookup can't be interrupted, paused stream has no pending read: don't make caller wait
+        fail_if_cancelled();
+    }
+    unpause();
+}
+
+void httb::async_session::unpause() {
+    m_paused = false;
+    m_paused_work.reset();
+    // may be the last reference, so release it last
+    auto self = std::move(m_paused_self);
+}
+
+void httb::async_session::on_deadline(boost::system::error_code ec) {
+    if (ec || m_cancelled || m_finished) {
+        return;
+    }
+    v("deadline", "Deadline expired, aborting request");
+    m_deadline_expired = true;
+    abort();
+}
+
+std::chrono::steady_clock::duration httb::async_session::phase_timeout(std::chrono::steady_clock::duration timeout) const {
+    if (m_deadline == std::chrono::steady_clock::time_point::max()) {
+        return timeout;
+    }
+    const auto left = m_deadline - std::chrono::steady_clock::now();
+    return std::max(std::chrono::steady_clock::duration::zero(), std::min(timeout, left));
+}
+
+bool httb::async_session::fail_if_cancelled() {
+    if (!m_cancelled && !m_deadline_expired) {
+        return false;
+    }
+    fail(net::error::operation_aborted, "cancel");
+    return true;
+}
+
 void httb::async_session::fail(boost::system::error_code ec, char const* where) {
+    if (m_finished) {
+        return;
+    }
+    m_finished = true;
+    m_deadline_timer.cancel();
+    if (!m_cancelled && (m_deadline_expired || std::chrono::steady_clock::now() >= m_deadline)) {
+        // phase timeout clamped by deadline or any error after it expired is reported as deadline
+        ec = net::error::timed_out;
+        where = "deadline";
+    }
     if (m_error_func) {
         m_error_func(ec, std::string(where));
     }
@@ -235,5 +672,5 @@ void httb::async_session::v(const std::string& tag, const std::string& msg) {
 }
 
 boost::beast::tcp_stream* httb::async_session::stream() {
-    return m_request_raw.is_ssl() ? &m_stream_ssl->next_layer() : m_stream_raw;
+    return &m_conn->tcp();
 }
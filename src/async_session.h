@@ -10,8 +10,12 @@
 #ifndef HTTB_ASYNC_SESSION_H
 #define HTTB_ASYNC_SESSION_H
 
+#include "connection_pool.h"
+#include "dns_cache.h"
+#include "happy_eyeballs.h"
 #include "httb/request.h"
 #include "httb/types.h"
+#include "tls_session_cache.h"
 
 #include <boost/asio.hpp>
 #include <boost/asio/connect.hpp>
@@ -42,11 +46,13 @@
 #include <istream>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <ostream>
 #include <string>
 #include <thread>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 namespace httb {
 
@@ -57,12 +63,49 @@ namespace net = boost::asio;
 namespace beast = boost::beast;
 using namespace std::chrono_literals;
 
+class async_session;
+
+/// \brief Cancellation state of one logical request. Request may consist of several sessions (one per redirect),
+/// current one is cancelled and next ones are cancelled right after attach. Request may also run several attempts
+/// (hedging), each one has own child state
+class cancel_state {
+public:
+    /// \brief Cancel attached session. Thread-safe, may be called multiple times
+    void cancel();
+    bool cancelled() const;
+
+    /// \brief Resume paused stream of attached session
+    void resume();
+
+    /// \brief Attach new session of request, previous one is forgotten
+    /// \param session
+    void attach(const std::shared_ptr<httb::async_session>& session);
+
+    /// \brief Add child state, that is cancelled together with this one
+    /// \param child
+    void link(const std::shared_ptr<httb::cancel_state>& child);
+
+    /// \brief Set handler to cancel something else than session, e.g. timer. Called right away if already cancelled
+    /// \param handler nullptr to remove
+    void on_cancel(std::function<void()> handler);
+
+private:
+    mutable std::mutex m_lock;
+    bool m_cancelled = false;
+    std::weak_ptr<httb::async_session> m_session;
+    std::vector<std::weak_ptr<httb::cancel_state>> m_children;
+    std::function<void()> m_handler;
+};
+
 class async_session : public std::enable_shared_from_this<async_session> {
 public:
     /// \brief single constructor
     /// \param ctx boost asio io_context
     /// \param request
-    async_session(net::io_context& ctx, httb::request request, std::chrono::seconds conn_tout, std::chrono::seconds read_tout);
+    async_session(net::io_context& ctx,
+                  httb::request request,
+                  std::chrono::steady_clock::duration conn_tout,
+                  std::chrono::steady_clock::duration read_tout);
     virtual ~async_session();
 
     /// \brief Start executing http(s) request
@@ -78,23 +121,92 @@ public:
     /// \param progress
     void set_on_progress_cb(progress_func_t progress);
 
+    /// \brief Set keep-alive pool: session will try to take idle connection from it and return connection back after response
+    /// \param pool nullptr to disable keep-alive
+    void set_connection_pool(std::shared_ptr<httb::connection_pool> pool);
+
+    /// \brief Set shared ssl context with session cache. If not set, session creates own context
+    /// \param cache
+    void set_tls_session_cache(std::shared_ptr<httb::tls_session_cache> cache);
+
+    /// \brief Open new https connections over ktls_stream, to let kernel encrypt and decrypt records
+    /// \param enabled
+    void set_ktls(bool enabled);
+
+    /// \brief Kernel TLS offload state of connection used by request, valid in success callback
+    httb::ktls_status get_ktls_status() const;
+
+    /// \brief Set shared resolver cache. If not set, session resolves host by itself
+    /// \param dns
+    void set_dns_cache(std::shared_ptr<httb::dns_cache> dns);
+
+    /// \brief Set how to connect to host with multiple addresses
+    /// \param strategy
+    /// \param attempt_delay happy eyeballs delay between attempts
+    void set_connect_strategy(httb::connect_strategy strategy, std::chrono::milliseconds attempt_delay);
+
+    /// \brief Set absolute time limit for whole request. Every phase (resolve, connect, handshake, write, read) gets
+    /// remaining budget at most; when deadline expires, error callback is called with timed_out error in "deadline" phase.
+    /// Must be called before run()
+    /// \param deadline time_point::max() to disable
+    void set_deadline(std::chrono::steady_clock::time_point deadline);
+
+    /// \brief Enable streaming mode: body is not buffered, headers are passed to on_headers, and then body is passed
+    /// to on_chunk piece by piece as it comes. Success callback gets response without body.
+    /// Read timeout applies to every chunk. Must be called before run()
+    /// \param on_headers
+    /// \param on_chunk returns false to pause reading until resume()
+    void set_stream(std::function<void(const http::response_header<>&)> on_headers, httb::chunk_func_t on_chunk);
+
+    /// \brief Continue reading paused stream. Thread-safe, runs on session strand
+    void resume();
+
+    /// \brief Abort request: stop resolver and connect attempts, close socket. Error callback will be called
+    /// with operation_aborted, if request has not been already completed. Thread-safe, runs on session strand
+    void cancel();
+
 private:
+    net::io_context& m_ioc;
     boost::asio::io_service::strand m_strand;
-    boost::asio::ssl::context m_ssl_ctx;
+    std::shared_ptr<httb::tls_session_cache> m_tls_cache;
     tcp::resolver m_resolver;
-    beast::tcp_stream* m_stream_raw;
-    beast::ssl_stream<beast::tcp_stream>* m_stream_ssl;
+    std::shared_ptr<httb::dns_cache> m_dns;
+    httb::endpoints_t m_endpoints;
+    httb::connect_strategy m_connect_strategy = httb::connect_strategy::sequential;
+    std::chrono::milliseconds m_attempt_delay = 250ms;
+    std::shared_ptr<httb::happy_eyeballs_connector> m_connector;
+    std::shared_ptr<httb::connection_pool> m_pool;
+    std::unique_ptr<httb::connection> m_conn;
+    bool m_reused = false;
+    bool m_ktls = false;
+    httb::ktls_status m_ktls_status;
     beast::multi_buffer m_buffer; // (Must persist between reads)
     const httb::request m_request_raw;
     const http::request<request_body_type> m_request;
     http::response_parser<httb::response_body_type> m_response;
-    http::response_parser<httb::response_file_body_type> m_file_response;
+    /// \brief streaming mode parser, body is read into m_chunk
+    std::optional<http::response_parser<http::buffer_body>> m_stream_response;
+    std::function<void(const http::response_header<>&)> m_headers_func;
+    httb::chunk_func_t m_chunk_func;
+    std::unique_ptr<char[]> m_chunk;
+    /// \brief stream reading is paused by chunk callback
+    bool m_paused = false;
+    /// \brief paused session has no pending operations: it keeps itself and context alive until resume or cancel
+    std::shared_ptr<async_session> m_paused_self;
+    std::optional<net::executor_work_guard<net::io_context::executor_type>> m_paused_work;
     error_func_t m_error_func;
     success_func_t m_success_func;
     progress_func_t m_progress_func;
     bool m_verbose = false;
-    std::chrono::seconds m_conn_timeout = 30s;
-    std::chrono::seconds m_read_timeout = 30s;
+    bool m_cancelled = false;
+    bool m_finished = false;
+    bool m_deadline_expired = false;
+    /// \brief waiting for shared resolver cache
+    bool m_resolving = false;
+    std::chrono::steady_clock::duration m_conn_timeout = 30s;
+    std::chrono::steady_clock::duration m_read_timeout = 30s;
+    std::chrono::steady_clock::time_point m_deadline = std::chrono::steady_clock::time_point::max();
+    net::steady_timer m_deadline_timer;
     const std::vector<boost::system::error_code> m_ignored_errors{
         boost::asio::ssl::error::stream_truncated,
         boost::asio::error::eof,
@@ -102,20 +214,55 @@ private:
 
     inline bool is_ignored_error(boost::system::error_code ec);
     inline void fail(boost::system::error_code ec, char const* where);
+    /// \brief Fail with operation_aborted if session has been cancelled while operation was in progress,
+    /// or with timed_out if deadline expired
+    bool fail_if_cancelled();
+    /// \brief Stop all pending operations, their handlers complete with operation_aborted
+    void abort();
+    void on_deadline(boost::system::error_code ec);
+    /// \brief Phase timeout clamped to time left until deadline
+    std::chrono::steady_clock::duration phase_timeout(std::chrono::steady_clock::duration timeout) const;
 
     void v(const std::string& tag, const std::string& msg);
 
+    void resolve();
+    void open_connection();
+    void write_request();
     void read_response();
-    void read_response_ssl();
-    void read_response_plain();
+    void read_stream_header();
+    void read_stream_body();
+    /// \brief Repeat request over new connection if reused one has been closed by server before response.
+    /// Request which has been written is repeated only if it's idempotent
+    /// \param ec
+    /// \param written request has been written completely
+    /// \return true if request is being repeated
+    bool retry_stale(boost::system::error_code ec, bool written);
+    /// \brief Release paused state holders
+    void unpause();
+    /// \brief Finish successfully: return connection to pool or close it and call success callback
+    void complete(httb::response_t&& result, size_t bytesTransferred);
 
-    void on_resolve(boost::system::error_code ec, tcp::resolver::results_type results);
+    void on_resolve(boost::system::error_code ec, const httb::endpoints_t& endpoints);
     void on_connect(boost::system::error_code ec);
     void on_ssl_handshake(boost::system::error_code ec);
     void on_write(boost::system::error_code ec, std::size_t);
     void on_read(boost::system::error_code ec, std::size_t bytesTransferred);
+    void on_stream_header(boost::system::error_code ec, std::size_t bytesTransferred);
+    void on_stream_body(boost::system::error_code ec, std::size_t bytesTransferred);
 
     beast::tcp_stream* stream();
+
+    /// \brief Call f with stream of current connection: ssl, ktls or plain
+    template<typename Func>
+    void with_stream(Func&& f) {
+        if (m_conn->is_ktls()) {
+            f(m_conn->ktls());
+        } else if (m_conn->is_ssl()) {
+            f(m_conn->ssl());
+        } else {
+            f(m_conn->plain());
+        }
+    }
 };
 
 } // namespace httb
@@ -0,0 +1,521 @@
+/*!
+ * httb.
+ * batch_executor.cpp
+ *
+ * \date 2019
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+#include "batch_executor.h"
+
+#include "utils.h"
+
+#include <algorithm>
+#include <limits>
+#include <boost/asio/post.hpp>
+
+const size_t httb::batch_result_slots::FIRST_SEGMENT;
+const size_t httb::batch_result_slots::MAX_SEGMENTS;
+const size_t httb::batch_executor::START_CHUNK;
+
+httb::batch_result_slots::batch_result_slots() {
+}
+
+void httb::batch_result_slots::ensure(size_t size) {
+    while (m_capacity < size && m_count < MAX_SEGMENTS) {
+        const size_t segmentSize = FIRST_SEGMENT << m_count;
+        m_segments[m_count] = std::make_unique<httb::batch_result[]>(segmentSize);
+        m_capacity += segmentSize;
+        m_count++;
+    }
+}
+
+httb::batch_result& httb::batch_result_slots::at(size_t idx) {
+    // segment k starts at FIRST_SEGMENT * (2^k - 1)
+    size_t q = idx / FIRST_SEGMENT + 1;
+    size_t segment = 0;
+    while (q >>= 1) {
+        segment++;
+    }
+    return m_segments[segment][idx - FIRST_SEGMENT * ((size_t(1) << segment) - 1)];
+}
+
+std::vector<httb::batch_result> httb::batch_result_slots::release(size_t size) {
+    std::vector<httb::batch_result> out;
+    out.reserve(size);
+    for (size_t i = 0; i < size; i++) {
+        out.push_back(std::move(at(i)));
+    }
+    for (auto& segment : m_segments) {
+        segment.reset();
+    }
+    m_count = 0;
+    m_capacity = 0;
+    return out;
+}
+
+void httb::batch_executor::fair_queue::push(std::string key, task_t&& task) {
+    auto& queue = hosts[key];
+    if (queue.empty()) {
+        ring.push_back(std::move(key));
+    }
+    queue.push_back(std::move(task));
+    size++;
+}
+
+std::string httb::batch_executor::host_key(const httb::request& req) {
+    return httb::concurrency_limiter::make_key(req.get_host(), req.get_port_str());
+}
+
+httb::batch_executor::batch_executor(httb::client& client,
+                                     size_t threads,
+                                     bool work_stealing,
+                                     size_t max_in_flight,
+                                     size_t max_in_flight_per_host)
+    : m_client(client),
+      m_work_stealing(work_stealing),
+      m_max_in_flight(max_in_flight),
+      m_max_in_flight_per_host(max_in_flight_per_host),
+      // look ahead of window, to find requests of other hosts when some hosts are at limit
+      m_max_queued(max_in_flight == 0 ? std::numeric_limits<size_t>::max() : std::max(max_in_flight, START_CHUNK) * 2),
+      m_pool(threads),
+      m_limiter(client.m_limiter),
+      m_queued(0),
+      m_in_flight(0),
+      m_peak_in_flight(0),
+      m_stolen(0),
+      m_satisfied(false) {
+    for (size_t i = 0; i < m_pool.size(); i++) {
+        m_workers.push_back(std::make_unique<worker>());
+    }
+}
+
+httb::batch_executor::~batch_executor() {
+}
+
+void httb::batch_executor::set_completion_policy(httb::completion_policy policy, size_t quorum) {
+    m_policy = policy;
+    m_quorum = std::max<size_t>(1, quorum);
+}
+
+void httb::batch_executor::run(source_func_t source, const result_func_t& cb) {
+    m_cb = cb;
+    m_source = std::move(source);
+    m_exhausted = false;
+    m_pulled = 0;
+    m_completed = 0;
+    m_succeeded = 0;
+    m_satisfied = false;
+    m_sessions.clear();
+    m_host_in_flight.clear();
+    m_track_hosts = m_max_in_flight_per_host != 0 || m_limiter->enabled();
+    m_queued = 0;
+    m_in_flight = 0;
+    m_peak_in_flight = 0;
+    m_stolen = 0;
+
+    m_pool.start();
+    for (size_t i = 0; i < m_pool.size(); i++) {
+        wake(i);
+    }
+    m_pool.join();
+
+    m_source = nullptr;
+    m_cb = nullptr;
+}
+
+std::vector<httb::batch_result> httb::batch_executor::run_collect(source_func_t source, size_t size_hint, bool keep_requests) {
+    m_slots = std::make_unique<httb::batch_result_slots>();
+    m_slots->ensure(size_hint);
+    m_keep_requests = keep_requests;
+
+    run(std::move(source), nullptr);
+
+    std::vector<httb::batch_result> out = m_slots->release(m_pulled);
+    m_slots.reset();
+    return out;
+}
+
+size_t httb::batch_executor::stolen() const {
+    return m_stolen;
+}
+
+size_t httb::batch_executor::peak_in_flight() const {
+    return m_peak_in_flight;
+}
+
+void httb::batch_executor::schedule(size_t idx) {
+    worker& w = *m_workers[idx];
+    w.waiting = false;
+
+    for (size_t i = 0; i < START_CHUNK; i++) {
+        pick_result res = try_start(idx);
+        if (res == pick_result::blocked) {
+            // first released slot will wake us. Check again, slot could be released right before flag set
+            w.waiting = true;
+            res = try_start(idx);
+            if (res == pick_result::blocked) {
+                return;
+            }
+            w.waiting = false;
+        }
+        if (res == pick_result::empty) {
+            return;
+        }
+    }
+
+    // let context process i/o of already started requests, then continue
+    wake(idx);
+}
+
+httb::batch_executor::pick_result httb::batch_executor::try_start(size_t idx) {
+    if (!acquire_slot()) {
+        return pick_result::blocked;
+    }
+
+    task_t task;
+    const pick_result res = next_task(idx, task);
+    if (res != pick_result::ok) {
+        --m_in_flight;
+        if (res == pick_result::empty) {
+            // we held slot for a moment, someone could fail to get it
+            wake_waiting();
+        }
+        return res;
+    }
+
+    start(idx, std::move(task));
+    return pick_result::ok;
+}
+
+bool httb::batch_executor::acquire_slot() {
+    size_t current;
+    if (m_max_in_flight == 0) {
+        current = ++m_in_flight;
+    } else {
+        current = m_in_flight.load();
+        do {
+            if (current >= m_max_in_flight) {
+                return false;
+            }
+        } while (!m_in_flight.compare_exchange_weak(current, current + 1));
+        current++;
+    }
+
+    size_t peak = m_peak_in_flight.load();
+    while (current > peak && !m_peak_in_flight.compare_exchange_weak(peak, current)) {
+    }
+    return true;
+}
+
+size_t httb::batch_executor::host_limit(const std::string& key) const {
+    const size_t adaptive = m_limiter->limit(key);
+    if (adaptive == 0) {
+        return m_max_in_flight_per_host;
+    }
+    return m_max_in_flight_per_host == 0 ? adaptive : std::min(m_max_in_flight_per_host, adaptive);
+}
+
+bool httb::batch_executor::acquire_host(const std::string& key) {
+    if (!m_track_hosts) {
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(m_hosts_lock);
+    const size_t limit = host_limit(key);
+    size_t& count = m_host_in_flight[key];
+    if (limit != 0 && count >= limit) {
+        return false;
+    }
+    count++;
+    return true;
+}
+
+void httb::batch_executor::release_host(const std::string& key) {
+    if (!m_track_hosts) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_hosts_lock);
+    auto it = m_host_in_flight.find(key);
+    if (it != m_host_in_flight.end() && --it->second == 0) {
+        m_host_in_flight.erase(it);
+    }
+}
+
+httb::batch_executor::pick_result httb::batch_executor::next_task(size_t idx, task_t& out) {
+    pick_result res = pick(idx, out);
+    if (res == pick_result::ok) {
+        return res;
+    }
+
+    if (pull(idx)) {
+        res = pick(idx, out);
+        if (res == pick_result::ok) {
+            return res;
+        }
+    }
+
+    if (m_work_stealing && res == pick_result::empty && steal(idx)) {
+        res = pick(idx, out);
+    }
+    return res;
+}
+
+httb::batch_executor::pick_result httb::batch_executor::pick(size_t idx, task_t& out) {
+    worker& w = *m_workers[idx];
+    std::lock_guard<std::mutex> lock(w.lock);
+    fair_queue& q = w.queue;
+    if (q.size == 0) {
+        return pick_result::empty;
+    }
+
+    // round-robin: each host gets its turn, hosts at limit are skipped
+    for (size_t i = 0, n = q.ring.size(); i < n; i++) {
+        std::string key = std::move(q.ring.front());
+        q.ring.pop_front();
+        if (!acquire_host(key)) {
+            q.ring.push_back(std::move(key));
+            continue;
+        }
+
+        auto it = q.hosts.find(key);
+        out = std::move(it->second.front());
+        it->second.pop_front();
+        q.size--;
+        m_queued--;
+        if (it->second.empty()) {
+            q.hosts.erase(it);
+        } else {
+            q.ring.push_back(std::move(key));
+        }
+        return pick_result::ok;
+    }
+
+    return pick_result::blocked;
+}
+
+bool httb::batch_executor::pull(size_t idx) {
+    if (m_queued >= m_max_queued) {
+        return false;
+    }
+
+    std::vector<task_t> pulled;
+    bool finished = false;
+    {
+        std::lock_guard<std::mutex> lock(m_source_lock);
+        if (m_exhausted) {
+            return false;
+        }
+        // don't build requests far ahead of window
+        const size_t count = m_max_in_flight == 0 ? START_CHUNK : std::min(START_CHUNK, m_max_in_flight);
+        for (size_t i = 0; i < count; i++) {
+            httb::request req;
+            if (!m_source(req)) {
+                m_exhausted = true;
+                finished = m_completed == m_pulled;
+                break;
+            }
+            if (m_slots) {
+                // slots are allocated here only, under source lock
+                m_slots->ensure(m_pulled + 1);
+                if (m_keep_requests) {
+                    m_slots->at(m_pulled).request = req;
+                }
+            }
+            pulled.emplace_back(m_pulled++, std::move(req));
+        }
+    }
+
+    if (finished) {
+        // empty source or last requests completed before source said it's empty
+        m_pool.stop_when_idle();
+    }
+    if (pulled.empty()) {
+        return false;
+    }
+
+    m_queued += pulled.size();
+    worker& w = *m_workers[idx];
+    std::lock_guard<std::mutex> lock(w.lock);
+    for (auto& task : pulled) {
+        std::string key = host_key(task.second);
+        w.queue.push(std::move(key), std::move(task));
+    }
+    return true;
+}
+
+bool httb::batch_executor::steal(size_t idx) {
+    // victim is the worker with the longest queue
+    size_t victim = idx;
+    size_t longest = 0;
+    for (size_t i = 0; i < m_workers.size(); i++) {
+        if (i == idx) {
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(m_workers[i]->lock);
+        if (m_workers[i]->queue.size > longest) {
+            longest = m_workers[i]->queue.size;
+            victim = i;
+        }
+    }
+    if (victim == idx) {
+        return false;
+    }
+
+    std::vector<std::pair<std::string, task_t>> taken;
+    {
+        // take half from the back of host queues, one by one from different hosts; owner pops from the front
+        fair_queue& v = m_workers[victim]->queue;
+        std::lock_guard<std::mutex> lock(m_workers[victim]->lock);
+        const size_t count = (v.size + 1) / 2;
+        while (taken.size() < count && !v.ring.empty()) {
+            std::string key = std::move(v.ring.back());
+            v.ring.pop_back();
+            auto it = v.hosts.find(key);
+            taken.emplace_back(key, std::move(it->second.back()));
+            it->second.pop_back();
+            v.size--;
+            if (it->second.empty()) {
+                v.hosts.erase(it);
+            } else {
+                v.ring.push_front(std::move(key));
+            }
+        }
+    }
+    if (taken.empty()) {
+        return false;
+    }
+
+    m_stolen += taken.size();
+    worker& w = *m_workers[idx];
+    std::lock_guard<std::mutex> lock(w.lock);
+    // restore submission order inside each host queue
+    for (auto it = taken.rbegin(); it != taken.rend(); ++it) {
+        w.queue.push(std::move(it->first), std::move(it->second));
+    }
+    return true;
+}
+
+void httb::batch_executor::start(size_t idx, task_t&& task) {
+    const size_t taskIdx = task.first;
+    std::string key = host_key(task.second);
+    auto onComplete = [this, idx, taskIdx, key](httb::response resp) {
+        on_complete(idx, taskIdx, key, std::move(resp));
+    };
+
+    if (m_policy == httb::completion_policy::all) {
+        // nothing to cancel, don't allocate cancel state
+        m_client.execute_session(m_pool.get(idx), task.second, onComplete, nullptr, nullptr);
+        return;
+    }
+
+    if (m_satisfied) {
+        // batch is already done, complete without start (but not recursively from scheduler)
+        net::post(m_pool.get(idx), [onComplete]() {
+            httb::response resp;
+            auto res = boost_err_to_rep_err(std::move(resp), net::error::operation_aborted);
+            res.set_body(res.get_body() + "::cancel");
+            onComplete(std::move(res));
+        });
+        return;
+    }
+
+    auto cancel = std::make_shared<httb::cancel_state>();
+    {
+        std::lock_guard<std::mutex> lock(m_sessions_lock);
+        if (m_satisfied) {
+            // satisfied right now: session will be cancelled on attach
+            cancel->cancel();
+        } else {
+            m_sessions[taskIdx] = cancel;
+        }
+    }
+    m_client.execute_session(m_pool.get(idx), task.second, onComplete, nullptr, cancel);
+}
+
+void httb::batch_executor::on_complete(size_t idx, size_t task_idx, const std::string& key, httb::response&& resp) {
+    const bool tracked = m_policy != httb::completion_policy::all;
+    if (tracked) {
+        std::lock_guard<std::mutex> lock(m_sessions_lock);
+        m_sessions.erase(task_idx);
+    }
+    const bool success = resp.success();
+
+    if (m_slots) {
+        // each slot has single writer, no lock needed
+        m_slots->at(task_idx).response = std::move(resp);
+    } else if (m_cb) {
+        m_cb(task_idx, std::move(resp));
+    }
+    release_host(key);
+
+    bool finished;
+    bool satisfied = false;
+    {
+        std::lock_guard<std::mutex> lock(m_source_lock);
+        m_completed++;
+        if (tracked && !m_satisfied && is_satisfied_by(success)) {
+            satisfied = true;
+            m_satisfied = true;
+            m_exhausted = true;
+        }
+        finished = m_exhausted && m_completed == m_pulled;
+    }
+    if (satisfied) {
+        cancel_in_flight();
+    }
+    if (finished) {
+        m_pool.stop_when_idle();
+        return;
+    }
+
+    --m_in_flight;
+    // released slot may be used by anyone: waiting worker may hold requests of the host that just got free slot
+    wake_waiting();
+    wake(idx);
+}
+
+bool httb::batch_executor::is_satisfied_by(bool success) {
+    if (success) {
+        m_succeeded++;
+    }
+
+    switch (m_policy) {
+        case httb::completion_policy::first_success:
+            return m_succeeded >= 1;
+        case httb::completion_policy::quorum:
+            return m_succeeded >= m_quorum;
+        case httb::completion_policy::fail_fast:
+            return !success;
+        default:
+            return false;
+    }
+}
+
+void httb::batch_executor::cancel_in_flight() {
+    std::unordered_map<size_t, std::shared_ptr<httb::cancel_state>> sessions;
+    {
+        std::lock_guard<std::mutex> lock(m_sessions_lock);
+        sessions.swap(m_sessions);
+    }
+    // cancel is posted to session strand, its callback comes later
+    for (auto& session : sessions) {
+        session.second->cancel();
+    }
+}
+
+void httb::batch_executor::wake(size_t idx) {
+    net::post(m_pool.get(idx), [this, idx]() {
+        schedule(idx);
+    });
+}
+
+void httb::batch_executor::wake_waiting() {
+    for (size_t i = 0; i < m_workers.size(); i++) {
+        if (m_workers[i]->waiting.exchange(false)) {
+            wake(i);
+        }
+    }
+}
@@ -0,0 +1,188 @@
+/*!
+ * httb.
+ * batch_executor.h
+ *
+ * \date 2019
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+#ifndef HTTB_BATCH_EXECUTOR_H
+#define HTTB_BATCH_EXECUTOR_H
+
+#include "async_session.h"
+#include "concurrency_limiter.h"
+#include "httb/client.h"
+#include "io_context_pool.h"
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace httb {
+
+/// \brief Growable array of batch results with stable slot addresses: segment k holds FIRST_SEGMENT << k slots,
+/// segments are never moved. Segments are allocated by single thread, while each slot is written by exactly one thread
+/// without locking.
+class batch_result_slots {
+public:
+    batch_result_slots();
+
+    /// \brief Allocate segments to hold at least size slots. Not thread-safe
+    void ensure(size_t size);
+
+    /// \brief Get slot. Slot must be allocated by ensure() before
+    httb::batch_result& at(size_t idx);
+
+    /// \brief Move results out in index order
+    /// \param size number of used slots
+    std::vector<httb::batch_result> release(size_t size);
+
+private:
+    static const size_t FIRST_SEGMENT = 64;
+    static const size_t MAX_SEGMENTS = 48;
+
+    std::unique_ptr<httb::batch_result[]> m_segments[MAX_SEGMENTS];
+    size_t m_count = 0;
+    size_t m_capacity = 0;
+};
+
+/// \brief Runs batch of requests on multiple io_contexts (one per thread).
+/// Requests are pulled lazily from source into small workers' local queues, and started only while
+/// number of in-flight requests is less than global window and number of in-flight requests to the same host
+/// is less than per-host limit (fixed one or client's adaptive one, whichever is less).
+/// Local queue is split by host, next request is picked round-robin across hosts, so slow host can't take whole window. If work stealing enabled, worker with empty queue
+/// takes half of the longest foreign queue. Session lives on context of worker that started it.
+/// With completion policy other than "all", batch stops pulling source once policy is satisfied: queued requests complete
+/// without start and in-flight sessions are cancelled, all of them with operation_aborted error.
+class batch_executor {
+public:
+    /// \brief Request with its submission index
+    using task_t = std::pair<size_t, httb::request>;
+    /// \brief Result callback, called from worker threads
+    using result_func_t = std::function<void(size_t, httb::response)>;
+    using source_func_t = httb::batch_request::request_source_func;
+
+    /// \brief
+    /// \param client client to execute requests with, must outlive executor
+    /// \param threads number of worker threads
+    /// \param work_stealing allow idle workers to take not started requests of other workers
+    /// \param max_in_flight max simultaneously executing requests, 0 - unlimited
+    /// \param max_in_flight_per_host max simultaneously executing requests to the same host and port, 0 - unlimited
+    batch_executor(httb::client& client, size_t threads, bool work_stealing, size_t max_in_flight, size_t max_in_flight_per_host);
+    virtual ~batch_executor();
+
+    /// \brief Set when batch is done before all requests completed
+    /// \param policy
+    /// \param quorum successful responses required by completion_policy::quorum
+    void set_completion_policy(httb::completion_policy policy, size_t quorum);
+
+    /// \brief Execute all requests and wait for completion
+    /// \param source request source, never called concurrently
+    /// \param cb called once for each request, from any worker thread
+    void run(source_func_t source, const result_func_t& cb);
+
+    /// \brief Execute all requests, wait for completion and collect results in submission order
+    /// \param source request source, never called concurrently
+    /// \param size_hint expected number of requests, to allocate result slots up front
+    /// \param keep_requests store copy of request in result
+    /// \return results
+    std::vector<httb::batch_result> run_collect(source_func_t source, size_t size_hint, bool keep_requests);
+
+    /// \brief How many requests were taken from other workers on last run
+    size_t stolen() const;
+
+    /// \brief Max in-flight requests reached on last run
+    size_t peak_in_flight() const;
+
+private:
+    enum class pick_result {
+        ok,
+        /// \brief there are queued requests, but their hosts are at limit
+        blocked,
+        empty,
+    };
+
+    /// \brief Requests not yet started, grouped by host
+    struct fair_queue {
+        std::unordered_map<std::string, std::deque<task_t>> hosts;
+        /// \brief hosts with queued requests in round-robin order
+        std::deque<std::string> ring;
+        size_t size = 0;
+
+        void push(std::string key, task_t&& task);
+    };
+
+    struct worker {
+        std::mutex lock;
+        fair_queue queue;
+        /// \brief worker has work, but window or host limit is reached
+        std::atomic<bool> waiting{false};
+    };
+
+    /// \brief How many requests worker starts or pulls from source at once
+    static const size_t START_CHUNK = 64;
+
+    static std::string host_key(const httb::request& req);
+
+    httb::client& m_client;
+    bool m_work_stealing;
+    size_t m_max_in_flight;
+    size_t m_max_in_flight_per_host;
+    size_t m_max_queued;
+    httb::completion_policy m_policy = httb::completion_policy::all;
+    size_t m_quorum = 1;
+    httb::io_context_pool m_pool;
+    std::vector<std::unique_ptr<worker>> m_workers;
+
+    std::mutex m_source_lock;
+    source_func_t m_source;
+    bool m_exhausted = false;
+    size_t m_pulled = 0;
+    size_t m_completed = 0;
+    size_t m_succeeded = 0;
+
+    std::shared_ptr<httb::concurrency_limiter> m_limiter;
+    bool m_track_hosts = false;
+    std::mutex m_hosts_lock;
+    std::unordered_map<std::string, size_t> m_host_in_flight;
+
+    std::atomic<size_t> m_queued;
+    std::atomic<size_t> m_in_flight;
+    std::atomic<size_t> m_peak_in_flight;
+    std::atomic<size_t> m_stolen;
+    std::atomic<bool> m_satisfied;
+    /// \brief in-flight requests cancel states by index, tracked only with completion policy
+    std::mutex m_sessions_lock;
+    std::unordered_map<size_t, std::shared_ptr<httb::cancel_state>> m_sessions;
+    result_func_t m_cb;
+    std::unique_ptr<httb::batch_result_slots> m_slots;
+    bool m_keep_requests = false;
+
+    void schedule(size_t idx);
+    pick_result try_start(size_t idx);
+    bool acquire_slot();
+    size_t host_limit(const std::string& key) const;
+    bool acquire_host(const std::string& key);
+    void release_host(const std::string& key);
+    pick_result next_task(size_t idx, task_t& out);
+    pick_result pick(size_t idx, task_t& out);
+    bool pull(size_t idx);
+    bool steal(size_t idx);
+    void start(size_t idx, task_t&& task);
+    void on_complete(size_t idx, size_t task_idx, const std::string& key, httb::response&& resp);
+    /// \brief Count completed request and check whether completion policy is satisfied. Called under source lock
+    bool is_satisfied_by(bool success);
+    void cancel_in_flight();
+    void wake(size_t idx);
+    void wake_waiting();
+};
+
+} // namespace httb
+
+#endif //HTTB_BATCH_EXECUTOR_H
@@ -0,0 +1,33 @@
+/*!
+ * httb.
+ * body_file.cpp
+ *
+ * \date 2019
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+#include "httb/body_file.h"
+
+#include "segment_source.h"
+
+httb::body_file::body_file(std::string path, std::string contentType)
+    : m_path(std::move(path)),
+      m_content_type(std::move(contentType)) {
+}
+
+httb::body_file::~body_file() {
+}
+
+std::string httb::body_file::build(httb::io_container* request) const {
+    return httb::segment_source::read_all(*build_source(request));
+}
+
+std::shared_ptr<const httb::body_source> httb::body_file::build_source(httb::io_container* request) const {
+    std::vector<httb::body_segment> segments;
+    segments.push_back(httb::segment_source::file_segment(m_path));
+    if (!m_content_type.empty()) {
+        request->set_header({"Content-Type", m_content_type});
+    }
+    return std::make_shared<httb::segment_source>(std::move(segments));
+}
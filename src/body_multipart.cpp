@@ -9,6 +9,7 @@
 
 #include "httb/body_multipart.h"
 
+#include "segment_source.h"
 #include "utils.h"
 
 #include <iostream>
@@ -23,7 +24,8 @@ httb::multipart_entry::multipart_entry(const std::string& name, const std::strin
 httb::multipart_entry::multipart_entry(const std::string& name, const httb::file_path_entry& pathEntry)
     : m_name(name),
       m_contentType(pathEntry.content_type),
-      m_filename(pathEntry.filename) {
+      m_filename(pathEntry.filename),
+      m_path(pathEntry.path) {
     m_bodyLoader = [pathEntry] {
         return toolbox::io::file_read_full(pathEntry.path);
     };
@@ -52,6 +54,9 @@ std::string httb::multipart_entry::content_type() const {
 std::string httb::multipart_entry::filename() const {
     return m_filename;
 }
+std::string httb::multipart_entry::path() const {
+    return m_path;
+}
 
 bool httb::multipart_entry::has_body() const {
     return !m_body.empty() || (m_bodyLoader && !m_filename.empty());
@@ -107,3 +112,48 @@ std::string httb::body_multipart::build(httb::io_container* request) const {
 
     return res;
 }
+
+std::string httb::body_multipart_stream::build(httb::io_container* request) const {
+    return httb::segment_source::read_all(*build_source(request));
+}
+
+std::shared_ptr<const httb::body_source> httb::body_multipart_stream::build_source(httb::io_container* request) const {
+    std::vector<httb::body_segment> parts;
+    // strings between files are merged
+    auto append = [&parts](const std::string& data) {
+        if (parts.empty() || !parts.back().path.empty()) {
+            parts.emplace_back();
+        }
+        parts.back().data += data;
+    };
+
+    for (const auto& entry : m_entries) {
+        if (!entry.has_body()) {
+            continue;
+        }
+
+        std::string head = "--" + boundaryName + "\r\n";
+        head += "Content-Disposition: form-data; name=\"" + entry.name() + "\"";
+        if (!entry.filename().empty()) {
+            head += "; filename=\"" + entry.filename() + "\"";
+        }
+        head += "\r\n";
+        if (!entry.content_type().empty()) {
+            head += "Content-Type: " + entry.content_type() + "\r\n";
+        }
+        head += "\r\n";
+        append(head);
+
+        const std::string path = entry.path();
+        if (path.empty()) {
+            append(entry.body());
+        } else {
+            parts.push_back(httb::segment_source::file_segment(path));
+        }
+        append("\r\n");
+    }
+    append("--" + boundaryName + "--\r\n");
+
+    request->set_header({"Content-Type", "multipart/form-data; boundary=" + boundaryName});
+    return std::make_shared<httb::segment_source>(std::move(parts));
+}
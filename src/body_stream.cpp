@@ -0,0 +1,84 @@
+/*!
+ * httb.
+ * body_stream.cpp
+ *
+ * \date 2019
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+#include "httb/body_stream.h"
+
+#include "segment_source.h"
+
+namespace {
+
+class producer_reader : public httb::body_source_reader {
+public:
+    explicit producer_reader(httb::body_stream::producer_func producer)
+        : m_producer(std::move(producer)) {
+    }
+
+    boost::asio::const_buffer next(boost::system::error_code& ec) override {
+        // beast serializer asks for next piece only when previous one has been written: this is our flow control
+        while (!m_done) {
+            m_piece.clear();
+            m_done = !m_producer(m_piece, ec);
+            if (ec) {
+                return {};
+            }
+            if (!m_piece.empty()) {
+                return boost::asio::const_buffer(m_piece.data(), m_piece.size());
+            }
+        }
+        return {};
+    }
+
+private:
+    httb::body_stream::producer_func m_producer;
+    std::string m_piece;
+    bool m_done = false;
+};
+
+class producer_source : public httb::body_source {
+public:
+    producer_source(httb::body_stream::producer_factory_func factory, boost::optional<uint64_t> size)
+        : m_factory(std::move(factory)),
+          m_size(size) {
+    }
+
+    boost::optional<uint64_t> size() const override {
+        return m_size;
+    }
+
+    std::unique_ptr<httb::body_source_reader> open(boost::system::error_code& ec) const override {
+        ec = {};
+        return std::make_unique<producer_reader>(m_factory());
+    }
+
+private:
+    httb::body_stream::producer_factory_func m_factory;
+    boost::optional<uint64_t> m_size;
+};
+
+} // namespace
+
+httb::body_stream::body_stream(producer_factory_func factory, std::string contentType, boost::optional<uint64_t> size)
+    : m_factory(std::move(factory)),
+      m_content_type(std::move(contentType)),
+      m_size(size) {
+}
+
+httb::body_stream::~body_stream() {
+}
+
+std::string httb::body_stream::build(httb::io_container* request) const {
+    return httb::segment_source::read_all(*build_source(request));
+}
+
+std::shared_ptr<const httb::body_source> httb::body_stream::build_source(httb::io_container* request) const {
+    if (!m_content_type.empty()) {
+        request->set_header({"Content-Type", m_content_type});
+    }
+    return std::make_shared<producer_source>(m_factory, m_size);
+}
@@ -0,0 +1,219 @@
+/*!
+ * httb.
+ * circuit_breaker.cpp
+ *
+ * \date 2019
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+#include "circuit_breaker.h"
+
+#include "concurrency_limiter.h"
+
+#include <algorithm>
+
+const size_t httb::circuit_breaker::WINDOW;
+
+httb::circuit_breaker::permit::permit(std::shared_ptr<circuit_breaker> breaker, const httb::request& request) {
+    if (!breaker || !breaker->enabled()) {
+        return;
+    }
+    m_key = httb::concurrency_limiter::make_key(request.get_host(), request.get_port_str());
+    m_allowed = breaker->acquire(m_key, request, m_generation);
+    if (m_allowed) {
+        m_breaker = std::move(breaker);
+    }
+}
+
+httb::circuit_breaker::permit::~permit() {
+    // request was abandoned
+    finish(httb::response::INTERNAL_ERROR_OFFSET);
+}
+
+bool httb::circuit_breaker::permit::allowed() const {
+    return m_allowed;
+}
+
+void httb::circuit_breaker::permit::finish(int code) {
+    if (!m_breaker) {
+        return;
+    }
+    if (code == httb::response::DEADLINE_EXCEEDED || code == httb::response::CIRCUIT_OPEN) {
+        // caller's own time budget has run out, it says nothing about host
+        cancel();
+        return;
+    }
+    m_breaker->release(m_key, m_generation, true, is_failure(code));
+    m_breaker.reset();
+}
+
+void httb::circuit_breaker::permit::cancel() {
+    if (!m_breaker) {
+        return;
+    }
+    m_breaker->release(m_key, m_generation, false, false);
+    m_breaker.reset();
+}
+
+httb::circuit_breaker::circuit_breaker() {
+}
+
+httb::circuit_breaker::~circuit_breaker() {
+}
+
+bool httb::circuit_breaker::is_failure(int code) {
+    if (code == httb::response::DEADLINE_EXCEEDED || code == httb::response::CIRCUIT_OPEN) {
+        return false;
+    }
+    return code >= httb::response::INTERNAL_ERROR_OFFSET || code < 0 || code >= 500;
+}
+
+void httb::circuit_breaker::configure(bool enabled,
+                                      size_t consecutive_failures,
+                                      double failure_rate,
+                                      std::chrono::milliseconds open_duration,
+                                      size_t probes) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_enabled = enabled;
+    m_consecutive_failures = consecutive_failures;
+    m_failure_rate = std::min(1.0, std::max(0.0, failure_rate));
+    m_open_duration = open_duration;
+    m_probes = std::max<size_t>(1, probes);
+    m_hosts.clear();
+}
+
+void httb::circuit_breaker::set_listener(httb::circuit_listener_func listener) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_listener = std::move(listener);
+}
+
+bool httb::circuit_breaker::enabled() const {
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_enabled;
+}
+
+httb::circuit_state httb::circuit_breaker::state(const std::string& host, uint16_t port) const {
+    std::lock_guard<std::mutex> lock(m_lock);
+    auto it = m_hosts.find(httb::concurrency_limiter::make_key(host, std::to_string(port)));
+    if (it == m_hosts.end()) {
+        return httb::circuit_state::closed;
+    }
+    return it->second.state;
+}
+
+bool httb::circuit_breaker::acquire(const std::string& key, const httb::request& request, uint64_t& generation) {
+    std::vector<transition> transitions;
+    bool allowed;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        auto it = m_hosts.find(key);
+        if (it == m_hosts.end()) {
+            it = m_hosts.emplace(key, host_state()).first;
+            it->second.host = request.get_host();
+            it->second.port = request.get_port();
+        }
+        host_state& state = it->second;
+
+        if (state.state == httb::circuit_state::open && clock_t::now() - state.opened_at >= m_open_duration) {
+            switch_state(state, httb::circuit_state::half_open, transitions);
+        }
+
+        switch (state.state) {
+            case httb::circuit_state::closed:
+                allowed = true;
+                break;
+            case httb::circuit_state::half_open:
+                allowed = state.probes_started < m_probes;
+                if (allowed) {
+                    state.probes_started++;
+                }
+                break;
+            default:
+                allowed = false;
+                break;
+        }
+        generation = state.generation;
+    }
+
+    notify(transitions);
+    return allowed;
+}
+
+void httb::circuit_breaker::release(const std::string& key, uint64_t generation, bool counted, bool failed) {
+    std::vector<transition> transitions;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        auto it = m_hosts.find(key);
+        if (it == m_hosts.end() || it->second.generation != generation) {
+            // breaker has been reset or switched since request started
+            return;
+        }
+        host_state& state = it->second;
+
+        if (state.state == httb::circuit_state::half_open) {
+            if (!counted) {
+                // cancelled probe: let another request probe
+                state.probes_started--;
+            } else if (failed) {
+                switch_state(state, httb::circuit_state::open, transitions);
+            } else if (++state.probes_succeeded >= m_probes) {
+                switch_state(state, httb::circuit_state::closed, transitions);
+            }
+        } else if (state.state == httb::circuit_state::closed && counted) {
+            state.consecutive = failed ? state.consecutive + 1 : 0;
+
+            if (state.window.size() < WINDOW) {
+                state.window.push_back(failed);
+            } else {
+                state.window_failures -= state.window[state.window_next] ? 1 : 0;
+                state.window[state.window_next] = failed;
+                state.window_next = (state.window_next + 1) % WINDOW;
+            }
+            state.window_failures += failed ? 1 : 0;
+
+            const bool tooManyInRow = m_consecutive_failures != 0 && state.consecutive >= m_consecutive_failures;
+            const bool tooHighRate = m_failure_rate > 0 && state.window.size() == WINDOW &&
+                                     static_cast<double>(state.window_failures) >= m_failure_rate * WINDOW;
+            if (tooManyInRow || tooHighRate) {
+                switch_state(state, httb::circuit_state::open, transitions);
+            }
+        }
+    }
+
+    notify(transitions);
+}
+
+void httb::circuit_breaker::switch_state(host_state& state, httb::circuit_state to, std::vector<transition>& out) {
+    out.push_back({state.host, state.port, state.state, to});
+    state.state = to;
+    state.generation++;
+    state.probes_started = 0;
+    state.probes_succeeded = 0;
+    if (to == httb::circuit_state::open) {
+        state.opened_at = clock_t::now();
+    } else if (to == httb::circuit_state::closed) {
+        state.consecutive = 0;
+        state.window.clear();
+        state.window_next = 0;
+        state.window_failures = 0;
+    }
+}
+
+void httb::circuit_breaker::notify(const std::vector<transition>& transitions) {
+    if (transitions.empty()) {
+        return;
+    }
+
+    httb::circuit_listener_func listener;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        listener = m_listener;
+    }
+    if (!listener) {
+        return;
+    }
+    for (const auto& t : transitions) {
+        listener(t.host, t.port, t.from, t.to);
+    }
+}
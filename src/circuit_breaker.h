@@ -0,0 +1,123 @@
+/*!
+ * httb.
+ * circuit_breaker.h
+ *
+ * \date 2019
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+#ifndef HTTB_CIRCUIT_BREAKER_H
+#define HTTB_CIRCUIT_BREAKER_H
+
+#include "httb/client.h"
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace httb {
+
+/// \brief Thread-safe set of per-host (host and port) circuit breakers.
+/// Closed breaker opens when N consecutive requests failed or when failure rate of last WINDOW requests reached threshold.
+/// Open breaker rejects requests without sending them. After open duration it becomes half-open and lets a few probes
+/// through: if all of them succeed, breaker closes, any failed probe opens it again.
+/// Failure is transport error or 5xx response.
+class circuit_breaker {
+public:
+    using clock_t = std::chrono::steady_clock;
+
+    /// \brief How many last requests are used to calculate failure rate
+    static const size_t WINDOW = 20;
+
+    /// \brief Permission to send one request. Request counts as failed if finish() or cancel() wasn't called
+    class permit {
+    public:
+        /// \brief
+        /// \param breaker may be null or disabled, then request is always allowed
+        /// \param request
+        permit(std::shared_ptr<circuit_breaker> breaker, const httb::request& request);
+        permit(const permit&) = delete;
+        permit& operator=(const permit&) = delete;
+        ~permit();
+
+        /// \brief Whether request may be sent
+        bool allowed() const;
+
+        /// \brief Count request result. Deadline exceeded is not counted, like cancel()
+        /// \param code response code
+        void finish(int code);
+
+        /// \brief Request was cancelled by caller, result is not counted
+        void cancel();
+
+    private:
+        std::shared_ptr<circuit_breaker> m_breaker;
+        std::string m_key;
+        uint64_t m_generation = 0;
+        bool m_allowed = true;
+    };
+
+    circuit_breaker();
+    virtual ~circuit_breaker();
+
+    /// \brief Whether response code is counted as failure. Caller's deadline and open circuit are not host failures
+    static bool is_failure(int code);
+
+    /// \brief Set thresholds, all breakers are reset to closed state
+    /// \param enabled
+    /// \param consecutive_failures open after this number of failures in a row, 0 - don't count
+    /// \param failure_rate open when share of failures in window reaches it, 0 - don't count
+    /// \param open_duration how long to reject requests before probing
+    /// \param probes half-open probes required to close
+    void configure(bool enabled, size_t consecutive_failures, double failure_rate, std::chrono::milliseconds open_duration, size_t probes);
+    void set_listener(httb::circuit_listener_func listener);
+    bool enabled() const;
+
+    httb::circuit_state state(const std::string& host, uint16_t port) const;
+
+private:
+    struct host_state {
+        std::string host;
+        uint16_t port = 0;
+        httb::circuit_state state = httb::circuit_state::closed;
+        /// \brief incremented on each transition, results of requests started before it are ignored
+        uint64_t generation = 0;
+        size_t consecutive = 0;
+        /// \brief last results, true - failure
+        std::vector<bool> window;
+        size_t window_next = 0;
+        size_t window_failures = 0;
+        clock_t::time_point opened_at;
+        size_t probes_started = 0;
+        size_t probes_succeeded = 0;
+    };
+
+    struct transition {
+        std::string host;
+        uint16_t port;
+        httb::circuit_state from;
+        httb::circuit_state to;
+    };
+
+    mutable std::mutex m_lock;
+    bool m_enabled = false;
+    size_t m_consecutive_failures = 5;
+    double m_failure_rate = 0.5;
+    std::chrono::milliseconds m_open_duration{5000};
+    size_t m_probes = 3;
+    httb::circuit_listener_func m_listener;
+    std::unordered_map<std::string, host_state> m_hosts;
+
+    bool acquire(const std::string& key, const httb::request& request, uint64_t& generation);
+    void release(const std::string& key, uint64_t generation, bool counted, bool failed);
+    void switch_state(host_state& state, httb::circuit_state to, std::vector<transition>& out);
+    void notify(const std::vector<transition>& transitions);
+};
+
+} // namespace httb
+
+#endif //HTTB_CIRCUIT_BREAKER_H
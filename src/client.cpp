@@ -9,8 +9,20 @@
 #include "httb/client.h"
 
 #include "async_session.h"
+#include "batch_executor.h"
+#include "circuit_breaker.h"
+#include "concurrency_limiter.h"
+#include "connection_pool.h"
+#include "dns_cache.h"
+#include "event_loop.h"
+#include "file_sink.h"
+#include "happy_eyeballs.h"
+#include "hedge_tracker.h"
+#include "retry_tracker.h"
 #include "httb/request.h"
+#include "tls_session_cache.h"
 #include "utils.h"
+#include "zero_copy_writer.h"
 
 #include <boost/asio/connect.hpp>
 #include <boost/asio/ip/tcp.hpp>
@@ -18,6 +30,11 @@
 #include <boost/asio/ssl/stream.hpp>
 #include <boost/beast/core/file.hpp>
 #include <boost/beast/version.hpp>
+#include <algorithm>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
 #include <thread>
 #include <toolbox/io.h>
 #include <toolbox/strings.hpp>
@@ -25,8 +42,15 @@
 
 httb::client_base::client_base()
     : m_ostream(&std::cout),
-      m_ctx(boost::asio::ssl::context::sslv23_client) {
-    //    load_root_certs(m_ctx);
+      m_ctx(std::make_shared<boost::asio::ssl::context>(boost::asio::ssl::context::sslv23_client)),
+      m_tls_cache(std::make_shared<httb::tls_session_cache>(m_ctx)),
+      m_dns(std::make_shared<httb::dns_cache>()),
+      m_pool(std::make_shared<httb::connection_pool>()),
+      m_limiter(std::make_shared<httb::concurrency_limiter>()),
+      m_hedge(std::make_shared<httb::hedge_tracker>()),
+      m_retry(std::make_shared<httb::retry_tracker>()),
+      m_breaker(std::make_shared<httb::circuit_breaker>()) {
+    //    load_root_certs(*m_ctx);
 }
 httb::client_base::~client_base() {
 }
@@ -43,6 +67,18 @@ void httb::client_base::set_read_timeout(size_t readSeconds) {
     m_read_timeout = std::chrono::seconds(readSeconds);
 }
 
+void httb::client_base::set_connection_timeout(std::chrono::steady_clock::duration timeout) {
+    m_conn_timeout = timeout;
+}
+
+void httb::client_base::set_read_timeout(std::chrono::steady_clock::duration timeout) {
+    m_read_timeout = timeout;
+}
+
+void httb::client_base::set_deadline(std::chrono::steady_clock::duration deadline) {
+    m_deadline = deadline;
+}
+
 void httb::client_base::set_follow_redirects(bool followRedirects, int maxBounces) {
     m_follow_redirects = followRedirects;
     m_max_redirect_bounces = maxBounces;
@@ -55,33 +91,379 @@ bool httb::client_base::get_follow_redirects() const {
     return m_follow_redirects;
 }
 
+void httb::client_base::set_keep_alive(bool enable) {
+    m_keep_alive = enable;
+    if (!m_keep_alive) {
+        m_pool->clear();
+    }
+}
+
+void httb::client_base::set_keep_alive_timeout(size_t idleSeconds) {
+    m_pool->set_idle_timeout(std::chrono::seconds(idleSeconds));
+}
+
+void httb::client_base::set_max_idle_connections(size_t maxPerHost) {
+    m_pool->set_max_idle(maxPerHost);
+}
+
+httb::connection_stats httb::client_base::get_connection_stats() const {
+    return m_pool->stats();
+}
+
+void httb::client_base::set_tls_session_resumption(bool enable) {
+    m_tls_cache->set_enabled(enable);
+    if (!enable) {
+        m_tls_cache->clear();
+    }
+}
+
+httb::tls_stats httb::client_base::get_tls_stats() const {
+    return m_tls_cache->stats();
+}
+
+void httb::client_base::set_ktls(bool enable) {
+    m_ktls = enable;
+}
+
+net::ssl::context& httb::client_base::get_ssl_context() {
+    return *m_ctx;
+}
+
+void httb::client_base::set_dns_cache(bool enable) {
+    m_dns->set_enabled(enable);
+    if (!enable) {
+        m_dns->clear();
+    }
+}
+
+void httb::client_base::set_dns_cache_ttl(size_t positiveSeconds, size_t negativeSeconds) {
+    m_dns->set_ttl(std::chrono::seconds(positiveSeconds), std::chrono::seconds(negativeSeconds));
+}
+
+void httb::client_base::add_resolve_override(const std::string& host, uint16_t port, const std::string& address) {
+    m_dns->add_override(host, port, address);
+}
+
+void httb::client_base::clear_dns_cache() {
+    m_dns->clear();
+}
+
+httb::dns_stats httb::client_base::get_dns_stats() const {
+    return m_dns->stats();
+}
+
+void httb::client_base::set_connect_strategy(httb::connect_strategy strategy, size_t attemptDelayMs) {
+    m_connect_strategy = strategy;
+    m_attempt_delay = std::chrono::milliseconds(attemptDelayMs);
+}
+
+void httb::client_base::set_adaptive_concurrency(httb::limit_algorithm algorithm, size_t initialLimit, size_t minLimit, size_t maxLimit) {
+    m_limiter->configure(algorithm, initialLimit, minLimit, maxLimit);
+}
+
+size_t httb::client_base::get_concurrency_limit(const std::string& host, uint16_t port) const {
+    return m_limiter->limit(httb::concurrency_limiter::make_key(host, std::to_string(port)));
+}
+
+std::unordered_map<std::string, size_t> httb::client_base::get_concurrency_limits() const {
+    return m_limiter->limits();
+}
+
+void httb::client_base::set_hedging(bool enable, double budget) {
+    m_hedge->configure(enable, budget);
+}
+
+void httb::client_base::set_hedge_delay(size_t delayMs) {
+    m_hedge->set_delay(std::chrono::milliseconds(delayMs));
+}
+
+void httb::client_base::set_hedge_percentile(double percentile) {
+    m_hedge->set_percentile(percentile);
+}
+
+httb::hedge_stats httb::client_base::get_hedge_stats() const {
+    return m_hedge->stats();
+}
+
+void httb::client_base::set_retry(size_t maxRetries, size_t baseDelayMs, size_t maxDelayMs) {
+    m_retry->configure(maxRetries, std::chrono::milliseconds(baseDelayMs), std::chrono::milliseconds(maxDelayMs));
+}
+
+void httb::client_base::set_retry_budget(double ratio, size_t burst) {
+    m_retry->set_budget(ratio, burst);
+}
+
+void httb::client_base::set_retry_after(bool honor) {
+    m_retry->set_retry_after(honor);
+}
+
+httb::retry_stats httb::client_base::get_retry_stats() const {
+    return m_retry->stats();
+}
+
+void httb::client_base::set_circuit_breaker(bool enable, size_t consecutiveFailures, double failureRate, size_t openMs, size_t halfOpenProbes) {
+    m_breaker->configure(enable, consecutiveFailures, failureRate, std::chrono::milliseconds(openMs), halfOpenProbes);
+}
+
+void httb::client_base::set_circuit_listener(httb::circuit_listener_func listener) {
+    m_breaker->set_listener(std::move(listener));
+}
+
+httb::circuit_state httb::client_base::get_circuit_state(const std::string& host, uint16_t port) const {
+    return m_breaker->state(host, port);
+}
+
 httb::client::client()
     : client_base() {
 }
 httb::client::~client() {
+    // loop threads use client, stop them first
+    m_loop.reset();
 }
 
-httb::response httb::client::execute_blocking(const httb::request& request) {
+void httb::client::set_event_loop(size_t threads) {
+    m_loop.reset();
+    if (threads > 0) {
+        m_loop = std::make_unique<httb::event_loop>(threads);
+    }
+}
+
+void httb::client::submit(const httb::request& request, const response_func_t& cb, const progress_func_t& onProgress) {
+    if (!m_loop) {
+        throw std::runtime_error("Event loop is not enabled");
+    }
+    m_loop->submit([this, request, cb, onProgress](boost::asio::io_context& ioc) {
+        execute_session(ioc, request, cb, onProgress, nullptr);
+    });
+}
+
+using blocking_parser_t = boost::beast::http::response_parser<httb::response_body_type>;
+
+/// \brief Read buffer of blocking requests, larger one is released after request
+static const size_t MAX_BLOCKING_BUFFER = 64 * 1024;
+
+/// \brief Per-thread read buffer of blocking requests: keeps capacity between calls
+static boost::beast::flat_buffer& blocking_buffer() {
+    static thread_local boost::beast::flat_buffer buffer;
+    buffer.clear();
+    return buffer;
+}
+
+/// \brief Per-thread event loop of blocking requests with deadline: connections pooled on it are reused by next calls
+/// of the thread and purged when thread exits
+static boost::asio::io_context& blocking_loop() {
+    static thread_local boost::asio::io_context ioc(1);
+    return ioc;
+}
+
+/// \return false if request has not been written
+template<typename Stream>
+static bool write_read_blocking(Stream& stream,
+                                boost::beast::tcp_stream& lowest,
+                                const boost::beast::http::request<httb::request_body_type>& req,
+                                boost::beast::flat_buffer& buffer,
+                                blocking_parser_t& parser,
+                                std::chrono::steady_clock::duration read_timeout,
+                                bool plainWrites,
+                                boost::system::error_code& ec) {
+    namespace http = boost::beast::http;
+
+    // Send the HTTP request to the remote host
+    if (plainWrites && httb::zero_copy_writer::supported(req, false)) {
+        httb::zero_copy_writer writer(lowest.socket(), req);
+        writer.write(ec);
+    } else {
+        http::write(stream, req, ec);
+    }
+    if (ec) {
+        return false;
+    }
+
+    // set read timeout
+    lowest.expires_after(read_timeout);
+    // Receive the HTTP response
+    http::read(stream, buffer, parser, ec);
+    return true;
+}
+
+/// \brief Response with status and headers, without body
+static httb::response make_response(const boost::beast::http::response_header<>& header) {
     httb::response resp;
+    resp.status = header.result();
+    resp.code = static_cast<typename std::underlying_type<httb::response::http_status>::type>(header.result());
+    resp.status_message = header.reason().to_string();
+    for (auto const& field : header) {
+        resp.add_header({field.name_string().to_string(), field.value().to_string()});
+    }
+    return resp;
+}
+
+static bool is_redirect(const httb::response& resp) {
+    return resp.status == httb::response::http_status::moved_permanently ||
+           resp.status == httb::response::http_status::found ||
+           resp.status == httb::response::http_status::temporary_redirect ||
+           resp.status == httb::response::http_status::permanent_redirect;
+}
+
+/// \brief Error response body of download is kept in memory, but not more than this
+static const size_t MAX_DOWNLOAD_ERROR_BODY = 64 * 1024;
+
+/// \brief Download target and not written to file body of error response
+struct download_state {
+    httb::file_sink file;
+    uint64_t total = 0;
+    std::string body;
+    /// \brief file error
     boost::system::error_code ec;
+};
 
-    using tcp = boost::asio::ip::tcp;
-    namespace http = boost::beast::http;
-    namespace ssl = boost::asio::ssl;
+/// \brief Response of request rejected by circuit breaker
+static httb::response circuit_open_response(const httb::request& request) {
+    httb::response resp;
+    resp.code = httb::response::CIRCUIT_OPEN;
+    resp.status = httb::response::http_status::unknown;
+    resp.status_message = "Circuit open";
+    resp.set_body("circuit breaker is open for " + request.get_host() + ":" + request.get_port_str());
+    return resp;
+}
+
+/// \brief Response of request failed with transport error. Retry classification needs error category,
+/// so it's done here: response keeps only error value
+static httb::response transport_error_response(const httb::request& request, boost::system::error_code ec) {
+    auto res = boost_err_to_rep_err(httb::response(), ec);
+    res.retryable = httb::retry_tracker::is_retryable(request, ec);
+    return res;
+}
 
-    // The io_context is required for all I/O
+static void connect_happy_eyeballs(boost::beast::tcp_stream& stream,
+                                   const httb::endpoints_t& endpoints,
+                                   std::chrono::milliseconds attempt_delay,
+                                   std::chrono::steady_clock::duration timeout,
+                                   boost::system::error_code& ec) {
+    // racing needs running event loop, but blocking context never runs: race in local context and move winner socket
     boost::asio::io_context ioc;
+    auto connector = std::make_shared<httb::happy_eyeballs_connector>(ioc.get_executor(), endpoints, attempt_delay, timeout);
+    connector->run([&stream, &ec](boost::system::error_code result, httb::happy_eyeballs_connector::socket_t& socket) {
+        ec = result;
+        if (ec) {
+            return;
+        }
+        const auto protocol = socket.local_endpoint(ec).protocol();
+        if (ec) {
+            return;
+        }
+        const auto native = socket.release(ec);
+        if (ec) {
+            return;
+        }
+        stream.socket().assign(protocol, native, ec);
+    });
+    ioc.run();
+}
+
+std::unique_ptr<httb::connection> httb::client::open_blocking(const httb::request& request, boost::system::error_code& ec) {
+    namespace ssl = boost::asio::ssl;
 
-    // These objects perform our I/O
-    tcp::resolver resolver{ioc};
     // Look up the domain name
+    const auto results = m_dns->resolve(request.get_host(), request.get_port_str(), ec);
+    if (ec) {
+        return nullptr;
+    }
 
-    const auto results = resolver.resolve(request.get_host(), request.get_port_str(), ec);
+    std::unique_ptr<httb::connection> conn;
+    if (request.is_ssl()) {
+        conn = std::make_unique<httb::connection>(m_blocking_ctx, m_blocking_ctx.get_executor(), *m_ctx, request.get_host(), request.get_port(), m_ktls);
+        conn->hold_ssl_context(m_ctx);
+        // Set SNI and offer cached session for this host
+        if (!m_tls_cache->prepare(conn->ssl_handle(), conn->key(), request.get_host())) {
+            ec = {static_cast<int>(::ERR_get_error()), boost::asio::error::get_ssl_category()};
+            return nullptr;
+        }
+    } else {
+        conn = std::make_unique<httb::connection>(m_blocking_ctx, m_blocking_ctx.get_executor(), request.get_host(), request.get_port());
+    }
 
-    if (ec) {
-        return boost_err_to_rep_err(std::move(resp), ec);
+    // set connection timeout
+    conn->tcp().expires_after(m_conn_timeout);
+    // Make the connection on the IP address we get from a lookup
+    if (m_connect_strategy == httb::connect_strategy::happy_eyeballs && results.size() > 1) {
+        connect_happy_eyeballs(conn->tcp(), results, m_attempt_delay, m_conn_timeout, ec);
+        if (ec) {
+            return nullptr;
+        }
+    } else {
+        conn->tcp().connect(results);
+    }
+
+    if (conn->is_ktls()) {
+        conn->ktls().handshake(ec);
+        if (ec) {
+            return nullptr;
+        }
+        m_tls_cache->on_handshake(conn->ssl_handle());
+        m_tls_cache->on_ktls(conn->ktls_status());
+    } else if (request.is_ssl()) {
+        // Perform the SSL handshake
+        conn->ssl().handshake(ssl::stream_base::client);
+        m_tls_cache->on_handshake(conn->ssl_handle());
+    }
+    conn->tcp().expires_never();
+    m_pool->on_created();
+
+    return conn;
+}
+
+httb::response httb::client::execute_blocking(const httb::request& request) {
+    if (request.get_deadline() > std::chrono::steady_clock::duration::zero() || m_deadline > std::chrono::steady_clock::duration::zero()) {
+        // synchronous socket operations can't be interrupted by deadline: run request in event loop of thread,
+        // retries wait on its timer and are bounded by deadline
+        boost::asio::io_context* ioc = &blocking_loop();
+        std::unique_ptr<boost::asio::io_context> nested;
+        if (ioc->get_executor().running_in_this_thread()) {
+            // called from handler of this loop, it can't be run again
+            nested = std::make_unique<boost::asio::io_context>(1);
+            ioc = nested.get();
+        }
+        httb::response resp;
+        execute_session(
+            *ioc, request, [&resp](httb::response result) {
+                resp = std::move(result);
+            },
+            nullptr, nullptr, false);
+        ioc->restart();
+        ioc->run();
+        return resp;
+    }
+
+    if (!m_retry->enabled()) {
+        return execute_blocking_once(request);
     }
 
+    // no deadline here: retries run over pooled connections of blocking context, caller's thread waits for backoff
+    const std::string key = httb::concurrency_limiter::make_key(request.get_host(), request.get_port_str());
+    m_retry->on_request(key);
+    std::chrono::milliseconds delay(0);
+    for (size_t attempt = 0;; attempt++) {
+        httb::response resp = execute_blocking_once(request);
+        if (!m_retry->next(key, request, resp, attempt, delay)) {
+            return resp;
+        }
+        std::this_thread::sleep_for(delay);
+    }
+}
+
+httb::response httb::client::execute_blocking_once(const httb::request& request) {
+    httb::response resp;
+    boost::system::error_code ec;
+    httb::circuit_breaker::permit permit(m_breaker, request);
+    if (!permit.allowed()) {
+        return circuit_open_response(request);
+    }
+    // request that returned early with error is counted as dropped and failed
+    httb::concurrency_limiter::sample limitSample(m_limiter, request);
+
+    namespace http = boost::beast::http;
+
     auto req = request.to_beast_request();
 
     if (m_verbose && m_ostream) {
@@ -97,89 +479,90 @@ httb::response httb::client::execute_blocking(const httb::request& request) {
     }
 
     // This buffer is used for reading and must be persisted
-    boost::beast::flat_buffer buffer;
+    boost::beast::flat_buffer& buffer = blocking_buffer();
 
-    // Declare a container to hold the response
-    http::response<http::dynamic_body> res;
+    // Declare a parser to hold the response
+    std::optional<blocking_parser_t> parser;
+    parser.emplace();
+    parser->body_limit(std::numeric_limits<std::uint64_t>::max());
 
-    std::string s;
+    std::unique_ptr<httb::connection> conn;
+    if (m_keep_alive) {
+        conn = m_pool->acquire(m_blocking_ctx, request.get_host(), request.get_port(), request.is_ssl());
+    }
+    bool reused = conn != nullptr;
 
     try {
-        if (request.is_ssl()) {
-            beast::ssl_stream<beast::tcp_stream> stream{ioc, m_ctx};
-            // Set SNI Hostname (many hosts need this to handshake successfully)
-            if (!SSL_set_tlsext_host_name(stream.native_handle(), request.get_host().c_str())) {
-                boost::system::error_code
-                    ec{static_cast<int>(::ERR_get_error()), boost::asio::error::get_ssl_category()};
-                return boost_err_to_rep_err(std::move(resp), ec);
+        while (true) {
+            if (!conn) {
+                conn = open_blocking(request, ec);
+                if (ec) {
+                    return transport_error_response(request, ec);
+                }
             }
 
-            stream.next_layer().expires_after(std::chrono::seconds(m_conn_timeout));
-
-            // Make the connection on the IP address we get from a lookup
-            beast::get_lowest_layer(stream).connect(results);
-
-            // Perform the SSL handshake
-            stream.handshake(ssl::stream_base::client);
-
-            // Send the HTTP request to the remote host
-            http::write(stream, req, ec);
-
-            stream.next_layer().expires_after(std::chrono::seconds(m_read_timeout));
-            // Receive the HTTP response
-            http::read(stream, buffer, res, ec);
-
-            stream.next_layer().socket().shutdown(tcp::socket::shutdown_both, ec);
-
-            if (ec == boost::asio::ssl::error::stream_truncated) {
-                // it's just empty ssl response, not expected but not critical case
-                ec.assign(0, ec.category());
+            bool written;
+            if (conn->is_ktls()) {
+                written = write_read_blocking(conn->ktls(), conn->tcp(), req, buffer, *parser, m_read_timeout, conn->plain_writes(), ec);
+            } else if (conn->is_ssl()) {
+                written = write_read_blocking(conn->ssl(), conn->tcp(), req, buffer, *parser, m_read_timeout, false, ec);
+            } else {
+                written = write_read_blocking(conn->plain(), conn->tcp(), req, buffer, *parser, m_read_timeout, true, ec);
             }
 
-            if (ec == boost::asio::error::eof) {
-                // Rationale:
-                // https://stackoverflow.com/questions/25587403/boost-asio-ssl-async-shutdown-always-finishes-with-an-error
-                ec.assign(0, ec.category());
+            // server may have processed written request before closing connection: only idempotent one can be repeated
+            if (ec && reused && !parser->got_some() && (!written || request.is_idempotent())) {
+                // server closed idle connection right before we sent request, repeat over new connection
+                reused = false;
+                conn.reset();
+                ec = {};
+                buffer.clear();
+                parser.emplace();
+                parser->body_limit(std::numeric_limits<std::uint64_t>::max());
+                continue;
             }
-        } else {
-            beast::tcp_stream stream(ioc);
-            // set connection timeout
-            stream.expires_after(std::chrono::seconds(m_conn_timeout));
-            // Make the connection on the IP address we get from a lookup
-            beast::get_lowest_layer(stream).connect(results);
-            stream.expires_never();
-
-            // Send the HTTP request to the remote host
-            http::write(stream, req, ec);
+            break;
+        }
 
-            // set read timeout
-            stream.expires_after(std::chrono::seconds(m_read_timeout));
-            // Receive the HTTP response
-            http::read(stream, buffer, res, ec);
+        if (ec == boost::asio::ssl::error::stream_truncated) {
+            // it's just empty ssl response, not expected but not critical case
+            ec.assign(0, ec.category());
+        }
 
-            stream.socket().shutdown(tcp::socket::shutdown_both);
+        if (ec == boost::asio::error::eof) {
+            // Rationale:
+            // https://stackoverflow.com/questions/25587403/boost-asio-ssl-async-shutdown-always-finishes-with-an-error
+            ec.assign(0, ec.category());
         }
     } catch (const boost::system::system_error& e) {
         if (e.code() != boost::system::errc::not_connected) {
-            return boost_err_to_rep_err(std::move(resp), e);
+            return transport_error_response(request, e.code());
         }
     }
 
-    s = boost::beast::buffers_to_string(res.body().data());
-
     if (ec && ec != boost::system::errc::not_connected) {
-        return boost_err_to_rep_err(std::move(resp), ec);
+        return transport_error_response(request, ec);
+    }
+
+    auto res = parser->release();
+    const httb::ktls_status ktls = conn ? conn->ktls_status() : httb::ktls_status();
+    if (conn && m_keep_alive && parser->is_done()) {
+        m_pool->release(std::move(conn), req.keep_alive() && !res.need_eof(), res);
+    } else if (conn) {
+        conn->close();
     }
 
-    resp.status = res.result();
-    resp.code = static_cast<typename std::underlying_type<httb::response::http_status>::type>(res.result());
-    resp.status_message = res.reason().to_string();
-    for (auto const& field : res) {
-        resp.add_header(field.name_string().to_string(), field.value().to_string());
+    if (buffer.capacity() > MAX_BLOCKING_BUFFER) {
+        buffer.clear();
+        buffer.shrink_to_fit();
     }
-    resp.set_body(std::move(s));
 
-    res.body().consume(res.body().size());
+    resp = make_response(res);
+    resp.set_body(std::move(res.body()));
+    resp.ktls = ktls;
+
+    limitSample.finish(resp.code);
+    permit.finish(resp.code);
 
     if (m_follow_redirects) {
         int redirectBounces = 0;
@@ -209,43 +592,411 @@ httb::response httb::client::execute_blocking(const httb::request& request) {
     return resp;
 }
 
-void httb::client::execute_in_context(boost::asio::io_context& ioc,
-                                      const httb::request& request,
-                                      const response_func_t& cb,
-                                      const progress_func_t& onProgress) {
+httb::request_handle::request_handle(std::shared_ptr<httb::cancel_state> state)
+    : m_state(std::move(state)) {
+}
+
+void httb::request_handle::cancel() {
+    if (m_state) {
+        m_state->cancel();
+    }
+}
+
+bool httb::request_handle::cancelled() const {
+    return m_state && m_state->cancelled();
+}
+
+bool httb::request_handle::valid() const {
+    return static_cast<bool>(m_state);
+}
+
+void httb::request_handle::resume() {
+    if (m_state) {
+        m_state->resume();
+    }
+}
+
+httb::request_handle httb::client::execute_stream(boost::asio::io_context& ioc,
+                                                  const httb::request& request,
+                                                  const headers_func_t& onHeaders,
+                                                  const chunk_func_t& onChunk,
+                                                  const response_func_t& cb) {
+    auto cancel = std::make_shared<httb::cancel_state>();
+    // body that already has been passed to caller can't be taken back: no retries and hedges
+    execute_attempt(ioc, request, cb, nullptr, cancel, make_deadline(request), onHeaders, onChunk ? onChunk : [](const char*, size_t) {
+        return true;
+    });
+    return httb::request_handle(cancel);
+}
+
+httb::request_handle httb::client::download(boost::asio::io_context& ioc,
+                                            const httb::request& request,
+                                            const std::string& path,
+                                            const response_func_t& cb,
+                                            const progress_func_t& onProgress) {
+    auto cancel = std::make_shared<httb::cancel_state>();
+    auto state = std::make_shared<download_state>();
+
+    auto onHeaders = [state, cancel, path](const httb::response& headers) {
+        if (headers.code < 200 || headers.code >= 300) {
+            return;
+        }
+        state->file.open(path, state->ec);
+        if (state->ec) {
+            cancel->cancel();
+            return;
+        }
+        if (headers.has_header("content-length")) {
+            state->total = std::strtoull(headers.get_header_value("content-length").c_str(), nullptr, 10);
+            state->file.preallocate(state->total, state->ec);
+            if (state->ec) {
+                cancel->cancel();
+                return;
+            }
+        }
+    };
+
+    auto onChunk = [state, cancel, onProgress](const char* data, size_t size) {
+        if (state->ec) {
+            return true;
+        }
+        if (!state->file.is_open()) {
+            // not a download: error page
+            state->body.append(data, std::min(size, MAX_DOWNLOAD_ERROR_BODY - std::min(MAX_DOWNLOAD_ERROR_BODY, state->body.size())));
+            return true;
+        }
+        state->file.write(data, size, state->ec);
+        if (state->ec) {
+            cancel->cancel();
+            return true;
+        }
+        if (onProgress) {
+            const uint64_t loaded = state->file.size();
+            onProgress(loaded, state->total, state->total == 0 ? 0.0 : (double) loaded / (double) state->total);
+        }
+        return true;
+    };
+
+    auto onComplete = [state, cb](httb::response resp) {
+        if (!state->ec && state->file.is_open() && resp.success()) {
+            state->file.close(state->ec);
+        }
+        if (state->ec) {
+            // request has been aborted because of file error
+            state->file.discard();
+            cb(boost_err_to_rep_err(httb::response(), state->ec));
+            return;
+        }
+        if (state->file.is_open()) {
+            state->file.discard();
+        } else if (!resp.is_internal_error()) {
+            resp.set_body(std::move(state->body));
+        }
+        cb(std::move(resp));
+    };
+
+    execute_attempt(ioc, request, onComplete, nullptr, cancel, make_deadline(request), onHeaders, onChunk);
+    return httb::request_handle(cancel);
+}
+
+httb::response httb::client::download_blocking(const httb::request& request, const std::string& path, const progress_func_t& onProgress) {
+    net::io_context ioc;
+    httb::response resp;
+    download(ioc, request, path, [&resp](httb::response result) {
+        resp = std::move(result);
+    }, onProgress);
+    ioc.run();
+    return resp;
+}
+
+std::chrono::steady_clock::time_point httb::client::make_deadline(const httb::request& request) const {
+    const auto budget = request.get_deadline() > std::chrono::steady_clock::duration::zero() ? request.get_deadline() : m_deadline;
+    const auto deadline = budget > std::chrono::steady_clock::duration::zero() ? std::chrono::steady_clock::now() + budget
+                                                                              : std::chrono::steady_clock::time_point::max();
+    return deadline;
+}
+
+httb::request_handle httb::client::execute_in_context(boost::asio::io_context& ioc,
+                                                      const httb::request& request,
+                                                      const response_func_t& cb,
+                                                      const progress_func_t& onProgress) {
+    auto cancel = std::make_shared<httb::cancel_state>();
+    execute_session(ioc, request, cb, onProgress, cancel);
+    return httb::request_handle(cancel);
+}
+
+void httb::client::execute_session(boost::asio::io_context& ioc,
+                                   const httb::request& request,
+                                   const response_func_t& cb,
+                                   const progress_func_t& onProgress,
+                                   std::shared_ptr<httb::cancel_state> cancel,
+                                   bool canHedge) {
+    // time budget covers all redirect hops, retries and hedges
+    const auto deadline = make_deadline(request);
+
+    if (!m_retry->enabled()) {
+        execute_request(ioc, request, cb, onProgress, cancel, deadline, canHedge);
+        return;
+    }
+
+    m_retry->on_request(httb::concurrency_limiter::make_key(request.get_host(), request.get_port_str()));
+    execute_retry(ioc, request, cb, onProgress, cancel, deadline, 0, std::chrono::milliseconds(0), canHedge);
+}
+
+void httb::client::execute_retry(boost::asio::io_context& ioc,
+                                 const httb::request& request,
+                                 const response_func_t& cb,
+                                 const progress_func_t& onProgress,
+                                 std::shared_ptr<httb::cancel_state> cancel,
+                                 std::chrono::steady_clock::time_point deadline,
+                                 size_t attempt,
+                                 std::chrono::milliseconds delay,
+                                 bool canHedge) {
+    auto onResponse = [this, &ioc, request, cb, onProgress, cancel, deadline, attempt, delay, canHedge](httb::response resp) {
+        const std::string key = httb::concurrency_limiter::make_key(request.get_host(), request.get_port_str());
+        std::chrono::milliseconds nextDelay = delay;
+        // retry that would start after deadline is not made and doesn't take retry budget
+        if ((cancel && cancel->cancelled()) || resp.code == httb::response::DEADLINE_EXCEEDED ||
+            !m_retry->next(key, request, resp, attempt, nextDelay, deadline)) {
+            if (cb) {
+                cb(std::move(resp));
+            }
+            return;
+        }
+
+        auto timer = std::make_shared<boost::asio::steady_timer>(ioc, nextDelay);
+        if (cancel) {
+            cancel->on_cancel([timer]() {
+                boost::asio::post(timer->get_executor(), [timer]() {
+                    timer->cancel();
+                });
+            });
+        }
+        timer->async_wait([this, &ioc, request, cb, onProgress, cancel, deadline, attempt, nextDelay, canHedge, timer](boost::system::error_code ec) {
+            if (cancel) {
+                cancel->on_cancel(nullptr);
+            }
+            if (ec || (cancel && cancel->cancelled())) {
+                httb::response resp;
+                auto res = boost_err_to_rep_err(std::move(resp), boost::asio::error::operation_aborted);
+                res.set_body(res.get_body() + "::cancel");
+                if (cb) {
+                    cb(std::move(res));
+                }
+                return;
+            }
+            execute_retry(ioc, request, cb, onProgress, cancel, deadline, attempt + 1, nextDelay, canHedge);
+        });
+    };
+
+    execute_request(ioc, request, onResponse, onProgress, cancel, deadline, canHedge);
+}
+
+void httb::client::execute_request(boost::asio::io_context& ioc,
+                                   const httb::request& request,
+                                   const response_func_t& cb,
+                                   const progress_func_t& onProgress,
+                                   std::shared_ptr<httb::cancel_state> cancel,
+                                   std::chrono::steady_clock::time_point deadline,
+                                   bool canHedge) {
+    if (!canHedge || onProgress || !m_hedge->applicable(request)) {
+        execute_attempt(ioc, request, cb, onProgress, cancel, deadline);
+        return;
+    }
+
+    const std::string key = httb::concurrency_limiter::make_key(request.get_host(), request.get_port_str());
+    const auto delay = m_hedge->on_request(key);
+    if (delay > std::chrono::steady_clock::duration::zero()) {
+        execute_hedged(ioc, request, cb, cancel, deadline, delay);
+        return;
+    }
+
+    // host latency is unknown yet, just learn it
+    auto hedge = m_hedge;
+    const auto started = std::chrono::steady_clock::now();
+    execute_attempt(
+        ioc, request, [hedge, key, started, cb](httb::response resp) {
+            if (!resp.is_internal_error()) {
+                hedge->on_response(key, std::chrono::steady_clock::now() - started, false);
+            }
+            if (cb) {
+                cb(std::move(resp));
+            }
+        },
+        nullptr, cancel, deadline);
+}
+
+/// \brief Shared state of request and its hedge
+struct hedge_race {
+    explicit hedge_race(boost::asio::io_context& ioc)
+        : timer(ioc) {
+    }
+
+    std::mutex lock;
+    boost::asio::steady_timer timer;
+    bool done = false;
+    size_t running = 1;
+    std::shared_ptr<httb::cancel_state> attempts[2];
+    std::chrono::steady_clock::time_point started;
+};
+
+void httb::client::execute_hedged(boost::asio::io_context& ioc,
+                                  const httb::request& request,
+                                  const response_func_t& cb,
+                                  std::shared_ptr<httb::cancel_state> cancel,
+                                  std::chrono::steady_clock::time_point deadline,
+                                  std::chrono::steady_clock::duration delay) {
+    auto race = std::make_shared<hedge_race>(ioc);
+    race->started = std::chrono::steady_clock::now();
+    auto hedge = m_hedge;
+    const std::string key = httb::concurrency_limiter::make_key(request.get_host(), request.get_port_str());
+
+    auto onComplete = [race, hedge, key, cb](size_t attempt, httb::response resp) {
+        std::shared_ptr<httb::cancel_state> loser;
+        {
+            std::lock_guard<std::mutex> lock(race->lock);
+            if (race->done) {
+                // cancelled loser
+                return;
+            }
+            race->running--;
+            if (resp.is_internal_error() && race->running > 0) {
+                // transport error of one attempt, the other one still may succeed
+                return;
+            }
+            race->done = true;
+            race->timer.cancel();
+            loser = race->attempts[1 - attempt];
+        }
+        if (loser) {
+            loser->cancel();
+        }
+        if (!resp.is_internal_error()) {
+            hedge->on_response(key, std::chrono::steady_clock::now() - race->started, attempt == 1);
+        }
+        if (cb) {
+            cb(std::move(resp));
+        }
+    };
+
+    for (auto& attempt : race->attempts) {
+        attempt = std::make_shared<httb::cancel_state>();
+        if (cancel) {
+            cancel->link(attempt);
+        }
+    }
+
+    execute_attempt(
+        ioc, request, [onComplete](httb::response resp) {
+            onComplete(0, std::move(resp));
+        },
+        nullptr, race->attempts[0], deadline);
+
+    race->timer.expires_after(delay);
+    race->timer.async_wait([this, &ioc, race, request, onComplete, deadline](boost::system::error_code ec) {
+        if (ec || std::chrono::steady_clock::now() >= deadline) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(race->lock);
+            if (race->done || !m_hedge->try_hedge()) {
+                return;
+            }
+            race->running++;
+        }
+        execute_attempt(
+            ioc, request, [onComplete](httb::response resp) {
+                onComplete(1, std::move(resp));
+            },
+            nullptr, race->attempts[1], deadline);
+    });
+}
+
+void httb::client::execute_attempt(boost::asio::io_context& ioc,
+                                   const httb::request& request,
+                                   const response_func_t& cb,
+                                   const progress_func_t& onProgress,
+                                   std::shared_ptr<httb::cancel_state> cancel,
+                                   std::chrono::steady_clock::time_point deadline,
+                                   const headers_func_t& onHeaders,
+                                   const chunk_func_t& onChunk) {
+    auto permit = std::make_shared<httb::circuit_breaker::permit>(m_breaker, request);
+    if (!permit->allowed()) {
+        httb::response resp = circuit_open_response(request);
+        boost::asio::post(ioc, [cb, resp = std::move(resp)]() mutable {
+            if (cb) {
+                cb(std::move(resp));
+            }
+        });
+        return;
+    }
+
     std::shared_ptr<httb::async_session> session = std::make_shared<httb::async_session>(ioc, request, m_conn_timeout, m_read_timeout);
     session->set_verbose(m_verbose);
     session->set_on_progress_cb(onProgress);
+    session->set_tls_session_cache(m_tls_cache);
+    session->set_ktls(m_ktls);
+    session->set_dns_cache(m_dns);
+    session->set_connect_strategy(m_connect_strategy, m_attempt_delay);
+    session->set_deadline(deadline);
+    if (m_keep_alive) {
+        session->set_connection_pool(m_pool);
+    }
+    if (onChunk) {
+        // redirect is followed by client: its headers and body are not passed to caller
+        auto redirect = std::make_shared<bool>(false);
+        const bool followRedirects = m_follow_redirects;
+        session->set_stream(
+            [onHeaders, redirect, followRedirects](const boost::beast::http::response_header<>& header) {
+                httb::response resp = make_response(header);
+                *redirect = followRedirects && is_redirect(resp) && resp.has_header("location");
+                if (!*redirect && onHeaders) {
+                    onHeaders(resp);
+                }
+            },
+            [onChunk, redirect](const char* data, size_t size) {
+                return *redirect || onChunk(data, size);
+            });
+    }
+
+    auto limitSample = std::make_shared<httb::concurrency_limiter::sample>(m_limiter, request);
+    if (cancel) {
+        cancel->attach(session);
+    }
 
     session->run(
-        [cb](boost::system::error_code ec, const std::string& wtf) {
-            httb::response resp;
-            auto res = boost_err_to_rep_err(std::move(resp), ec);
+        [cb, request, limitSample, permit, cancel](boost::system::error_code ec, const std::string& wtf) {
+            auto res = transport_error_response(request, ec);
             auto body = res.get_body();
             body += "::" + wtf;
             res.set_body(std::move(body));
-            cb(res);
+            if (wtf == "deadline") {
+                res.code = httb::response::DEADLINE_EXCEEDED;
+                res.retryable = false;
+            }
+            if (ec == boost::asio::error::operation_aborted && cancel && cancel->cancelled()) {
+                limitSample->cancel();
+                permit->cancel();
+            } else {
+                limitSample->finish(res.code);
+                permit->finish(res.code);
+            }
+            cb(std::move(res));
         },
-        [this, cb, onProgress, &ioc, &request](httb::response_t&& result, size_t) {
+        [this, cb, onProgress, &ioc, request, limitSample, permit, cancel, deadline, onHeaders, onChunk, raw = session.get()](httb::response_t&& result, size_t) {
             auto res = std::move(result);
-            std::string s = boost::beast::buffers_to_string(res.body().data());
-            httb::response resp;
-            resp.set_body(std::move(s));
-            resp.status = res.result();
-            resp.code = static_cast<typename std::underlying_type<httb::response::http_status>::type>(res.result());
-            resp.status_message = res.reason().to_string();
-            for (auto const& field : res) {
-                resp.add_header(field.name_string().to_string(), field.value().to_string());
-            }
+            httb::response resp = make_response(res);
+            // body has been read right into string, hand it over without copy
+            resp.set_body(std::move(res.body()));
+            // session owns this callback, so it's alive here
+            resp.ktls = raw->get_ktls_status();
 
-            res.body().consume(res.body().size());
+            limitSample->finish(resp.code);
+            permit->finish(resp.code);
 
-            if (m_follow_redirects && (resp.status == httb::response::http_status::moved_permanently ||
-                                       resp.status == httb::response::http_status::found ||
-                                       resp.status == httb::response::http_status::temporary_redirect ||
-                                       resp.status == httb::response::http_status::permanent_redirect)) {
+            if (m_follow_redirects && is_redirect(resp)) {
                 if (!resp.has_header("location")) {
-                    cb(resp);
+                    cb(std::move(resp));
                     return;
                 }
 
@@ -256,31 +1007,61 @@ void httb::client::execute_in_context(boost::asio::io_context& ioc,
                 redirectRequest.parse_url(resp.get_header_value("location"));
 
                 // overwrite current response with new request
-                execute_in_context(ioc, (redirectRequest), cb, onProgress);
+                execute_attempt(ioc, redirectRequest, cb, onProgress, cancel, deadline, onHeaders, onChunk);
                 return;
             }
 
             if (cb)
-                cb(resp);
+                cb(std::move(resp));
         });
 }
 
 void httb::client::execute(const httb::request& request,
                            const response_func_t& cb,
                            const progress_func_t& onProgress) {
+    if (m_loop) {
+        submit(request, cb, onProgress);
+        return;
+    }
+
     boost::asio::io_context ioc(2);
     execute_in_context(ioc, request, cb, onProgress);
     ioc.run();
 }
 
+const size_t httb::batch_request::DEFAULT_MAX_IN_FLIGHT;
+
 httb::batch_request::batch_request()
-    : m_concurrency(std::thread::hardware_concurrency()),
-      m_ctx(m_concurrency) {
+    : m_concurrency(std::max(1u, std::thread::hardware_concurrency())) {
 }
 
 httb::batch_request::batch_request(uint32_t concurrency)
-    : m_concurrency(concurrency),
-      m_ctx(m_concurrency) {
+    : m_concurrency(std::max(1u, concurrency)) {
+}
+
+void httb::batch_request::set_work_stealing(bool enabled) {
+    m_work_stealing = enabled;
+}
+
+void httb::batch_request::set_max_in_flight(size_t maxInFlight) {
+    m_max_in_flight = maxInFlight;
+}
+
+void httb::batch_request::set_max_in_flight_per_host(size_t maxInFlightPerHost) {
+    m_max_in_flight_per_host = maxInFlightPerHost;
+}
+
+void httb::batch_request::set_completion_policy(httb::completion_policy policy, size_t quorum) {
+    m_policy = policy;
+    m_quorum = std::max<size_t>(1, quorum);
+}
+
+httb::client& httb::batch_request::get_client() {
+    return m_client;
+}
+
+void httb::batch_request::set_source(request_source_func source) {
+    m_source = std::move(source);
 }
 
 const httb::batch_request& httb::batch_request::add(httb::request&& req) {
@@ -293,29 +1074,48 @@ const httb::batch_request& httb::batch_request::add(const httb::request& req) {
     return *this;
 }
 
+httb::batch_request::request_source_func httb::batch_request::make_source() {
+    return [this](httb::request& out) {
+        if (!m_requests.empty()) {
+            out = std::move(m_requests.front());
+            m_requests.pop_front();
+            return true;
+        }
+        return m_source && m_source(out);
+    };
+}
+
 void httb::batch_request::run_all(const httb::batch_request::on_response_each_func& cb) {
-    while (!m_requests.empty()) {
-        auto req = m_requests.back();
-        m_requests.pop_back();
-        m_client.execute_in_context(m_ctx, req, cb);
-    }
-    m_ctx.run();
+    std::mutex cbLock;
+    httb::batch_executor executor(m_client, m_concurrency, m_work_stealing, m_max_in_flight, m_max_in_flight_per_host);
+    executor.set_completion_policy(m_policy, m_quorum);
+    executor.run(make_source(), [&cbLock, &cb](size_t, httb::response result) {
+        std::lock_guard<std::mutex> lock(cbLock);
+        cb(std::move(result));
+    });
+    m_source = nullptr;
 }
 
 void httb::batch_request::run_all(const httb::batch_request::on_response_all_func& cb) {
+    httb::batch_executor executor(m_client, m_concurrency, m_work_stealing, m_max_in_flight, m_max_in_flight_per_host);
+    executor.set_completion_policy(m_policy, m_quorum);
+    std::vector<httb::batch_result> results = executor.run_collect(make_source(), m_requests.size(), false);
+    m_source = nullptr;
+
     std::vector<httb::response> out;
-    out.reserve(m_requests.size());
-    std::mutex resLock;
-
-    while (!m_requests.empty()) {
-        auto req = m_requests.back();
-        m_requests.pop_back();
-        m_client.execute_in_context(m_ctx, req, [&resLock, &out](httb::response result) {
-            std::lock_guard<std::mutex> lock(resLock);
-            out.push_back(std::move(result));
-        });
+    out.reserve(results.size());
+    for (auto& result : results) {
+        out.push_back(std::move(result.response));
     }
-    m_ctx.run();
 
-    cb(out);
+    cb(std::move(out));
+}
+
+void httb::batch_request::run_all(const httb::batch_request::on_result_all_func& cb) {
+    httb::batch_executor executor(m_client, m_concurrency, m_work_stealing, m_max_in_flight, m_max_in_flight_per_host);
+    executor.set_completion_policy(m_policy, m_quorum);
+    std::vector<httb::batch_result> results = executor.run_collect(make_source(), m_requests.size(), true);
+    m_source = nullptr;
+
+    cb(std::move(results));
 }
@@ -0,0 +1,181 @@
+/*!
+ * httb.
+ * concurrency_limiter.cpp
+ *
+ * \date 2019
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+#include "concurrency_limiter.h"
+
+#include <algorithm>
+#include <cmath>
+
+/// \brief AIMD: limit multiplier on drop
+static const double AIMD_BACKOFF = 0.9;
+/// \brief Gradient: how many samples long-term rtt average spans
+static const double GRADIENT_RTT_WINDOW = 100;
+/// \brief Gradient: rtt growth tolerated without limit decrease
+static const double GRADIENT_RTT_TOLERANCE = 1.5;
+/// \brief Gradient: weight of new limit
+static const double GRADIENT_SMOOTHING = 0.2;
+
+httb::concurrency_limiter::sample::sample(std::shared_ptr<concurrency_limiter> limiter, const httb::request& request) {
+    if (!limiter || !limiter->enabled()) {
+        return;
+    }
+    m_limiter = std::move(limiter);
+    m_key = make_key(request.get_host(), request.get_port_str());
+    m_started = clock_t::now();
+    m_limiter->on_start(m_key);
+}
+
+httb::concurrency_limiter::sample::~sample() {
+    // request was abandoned
+    finish(httb::response::INTERNAL_ERROR_OFFSET);
+}
+
+void httb::concurrency_limiter::sample::finish(int code) {
+    if (!m_limiter) {
+        return;
+    }
+    if (code == httb::response::DEADLINE_EXCEEDED || code == httb::response::CIRCUIT_OPEN) {
+        // caller's own time budget has run out, it says nothing about host
+        cancel();
+        return;
+    }
+    m_limiter->on_complete(m_key, clock_t::now() - m_started, is_drop(code));
+    m_limiter.reset();
+}
+
+void httb::concurrency_limiter::sample::cancel() {
+    if (!m_limiter) {
+        return;
+    }
+    m_limiter->on_cancel(m_key);
+    m_limiter.reset();
+}
+
+httb::concurrency_limiter::concurrency_limiter() {
+}
+
+httb::concurrency_limiter::~concurrency_limiter() {
+}
+
+std::string httb::concurrency_limiter::make_key(const std::string& host, const std::string& port) {
+    return host + ":" + port;
+}
+
+bool httb::concurrency_limiter::is_drop(int code) {
+    if (code == httb::response::DEADLINE_EXCEEDED || code == httb::response::CIRCUIT_OPEN) {
+        return false;
+    }
+    return code >= httb::response::INTERNAL_ERROR_OFFSET || code < 0 ||
+           code == 429 || code == 503 || code == 504;
+}
+
+void httb::concurrency_limiter::configure(httb::limit_algorithm algorithm, size_t initial, size_t min, size_t max) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_algorithm = algorithm;
+    m_min = static_cast<double>(std::max<size_t>(1, min));
+    m_max = static_cast<double>(std::max<size_t>(m_min, max));
+    m_initial = std::min(m_max, std::max(m_min, static_cast<double>(initial)));
+    m_hosts.clear();
+}
+
+bool httb::concurrency_limiter::enabled() const {
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_algorithm != httb::limit_algorithm::none;
+}
+
+size_t httb::concurrency_limiter::limit(const std::string& key) const {
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (m_algorithm == httb::limit_algorithm::none) {
+        return 0;
+    }
+
+    auto it = m_hosts.find(key);
+    const double value = it == m_hosts.end() ? m_initial : it->second.limit;
+    return static_cast<size_t>(value);
+}
+
+std::unordered_map<std::string, size_t> httb::concurrency_limiter::limits() const {
+    std::lock_guard<std::mutex> lock(m_lock);
+    std::unordered_map<std::string, size_t> out;
+    for (const auto& host : m_hosts) {
+        out[host.first] = static_cast<size_t>(host.second.limit);
+    }
+    return out;
+}
+
+void httb::concurrency_limiter::on_start(const std::string& key) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    get_state(key).in_flight++;
+}
+
+void httb::concurrency_limiter::on_complete(const std::string& key, clock_t::duration rtt, bool dropped) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    host_state& state = get_state(key);
+
+    const double rttUs = static_cast<double>(std::chrono::duration_cast<std::chrono::microseconds>(rtt).count());
+    if (m_algorithm == httb::limit_algorithm::aimd) {
+        update_aimd(state, dropped);
+    } else if (m_algorithm == httb::limit_algorithm::gradient) {
+        update_gradient(state, std::max(1.0, rttUs), dropped);
+    }
+
+    if (state.in_flight > 0) {
+        state.in_flight--;
+    }
+}
+
+void httb::concurrency_limiter::on_cancel(const std::string& key) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    host_state& state = get_state(key);
+    if (state.in_flight > 0) {
+        state.in_flight--;
+    }
+}
+
+httb::concurrency_limiter::host_state& httb::concurrency_limiter::get_state(const std::string& key) {
+    auto it = m_hosts.find(key);
+    if (it == m_hosts.end()) {
+        it = m_hosts.emplace(key, host_state()).first;
+        it->second.limit = m_initial;
+    }
+    return it->second;
+}
+
+void httb::concurrency_limiter::update_aimd(host_state& state, bool dropped) {
+    if (dropped) {
+        state.limit = std::max(m_min, std::floor(state.limit * AIMD_BACKOFF));
+    } else if (state.in_flight * 2 >= state.limit) {
+        // grow only if limit is really used, otherwise it would grow infinitely with low load
+        state.limit = std::min(m_max, state.limit + 1);
+    }
+}
+
+void httb::concurrency_limiter::update_gradient(host_state& state, double rtt, bool dropped) {
+    if (state.long_rtt == 0) {
+        state.long_rtt = rtt;
+    } else {
+        state.long_rtt += (rtt - state.long_rtt) * 2 / (GRADIENT_RTT_WINDOW + 1);
+    }
+
+    if (!dropped && state.in_flight * 2 < state.limit) {
+        // app-limited: latency says nothing about limit
+        return;
+    }
+
+    double newLimit;
+    if (dropped) {
+        newLimit = state.limit * 0.5;
+    } else {
+        // sqrt(limit) is allowed queue: limit probes up while latency is stable
+        const double gradient = std::max(0.5, std::min(1.0, GRADIENT_RTT_TOLERANCE * state.long_rtt / rtt));
+        newLimit = state.limit * gradient + std::sqrt(state.limit);
+    }
+    state.limit = state.limit * (1 - GRADIENT_SMOOTHING) + newLimit * GRADIENT_SMOOTHING;
+    state.limit = std::min(m_max, std::max(m_min, state.limit));
+}
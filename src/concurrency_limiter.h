@@ -0,0 +1,107 @@
+/*!
+ * httb.
+ * concurrency_limiter.h
+ *
+ * \date 2019
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+#ifndef HTTB_CONCURRENCY_LIMITER_H
+#define HTTB_CONCURRENCY_LIMITER_H
+
+#include "httb/client.h"
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace httb {
+
+/// \brief Thread-safe set of per-host adaptive concurrency limits.
+/// Each finished request gives sample: round-trip time and whether it was dropped (transport error, timeout, 429, 503, 504).
+/// AIMD: limit grows by 1 on success while host is busy (in-flight >= limit / 2) and shrinks by 10% on drop.
+/// Gradient: limit follows ratio of long-term average RTT to current RTT, so it shrinks when queueing
+/// on server side grows latency, and grows by sqrt(limit) while latency is stable.
+class concurrency_limiter {
+public:
+    using clock_t = std::chrono::steady_clock;
+
+    /// \brief Measures one request. Sample counts as dropped if finish() wasn't called
+    class sample {
+    public:
+        /// \brief
+        /// \param limiter may be null or disabled, then nothing measured
+        /// \param request
+        sample(std::shared_ptr<concurrency_limiter> limiter, const httb::request& request);
+        sample(const sample&) = delete;
+        sample& operator=(const sample&) = delete;
+        ~sample();
+
+        /// \brief Finish measure. Deadline exceeded is not recorded, like cancel()
+        /// \param code response code
+        void finish(int code);
+
+        /// \brief Request was cancelled by caller: it says nothing about host, no sample recorded
+        void cancel();
+
+    private:
+        std::shared_ptr<concurrency_limiter> m_limiter;
+        std::string m_key;
+        clock_t::time_point m_started;
+    };
+
+    concurrency_limiter();
+    virtual ~concurrency_limiter();
+
+    static std::string make_key(const std::string& host, const std::string& port);
+
+    /// \brief Whether response code means overloaded or unavailable upstream. Caller's deadline is not a drop
+    static bool is_drop(int code);
+
+    /// \brief Set algorithm and bounds, learned limits are reset
+    /// \param algorithm none disables limiter
+    /// \param initial limit for unknown host
+    /// \param min
+    /// \param max
+    void configure(httb::limit_algorithm algorithm, size_t initial, size_t min, size_t max);
+    bool enabled() const;
+
+    /// \brief Current limit of host
+    /// \param key host:port
+    /// \return limit, or 0 if limiter disabled
+    size_t limit(const std::string& key) const;
+
+    /// \brief All known hosts limits
+    /// \return map host:port -> limit
+    std::unordered_map<std::string, size_t> limits() const;
+
+    void on_start(const std::string& key);
+    void on_complete(const std::string& key, clock_t::duration rtt, bool dropped);
+    void on_cancel(const std::string& key);
+
+private:
+    struct host_state {
+        double limit = 0;
+        size_t in_flight = 0;
+        /// \brief exponentially smoothed long-term rtt, microseconds
+        double long_rtt = 0;
+    };
+
+    mutable std::mutex m_lock;
+    httb::limit_algorithm m_algorithm = httb::limit_algorithm::none;
+    double m_initial = 20;
+    double m_min = 1;
+    double m_max = 1000;
+    std::unordered_map<std::string, host_state> m_hosts;
+
+    host_state& get_state(const std::string& key);
+    void update_aimd(host_state& state, bool dropped);
+    void update_gradient(host_state& state, double rtt, bool dropped);
+};
+
+} // namespace httb
+
+#endif //HTTB_CONCURRENCY_LIMITER_H
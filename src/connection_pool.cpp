@@ -0,0 +1,408 @@
+/*!
+ * httb.
+ * connection_pool.cpp
+ *
+ * \date 2019
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+#include "connection_pool.h"
+
+#include <algorithm>
+#include <boost/asio/buffer.hpp>
+#include <boost/beast/core/string.hpp>
+#include <limits>
+
+static boost::string_view trim(boost::string_view value) {
+    while (!value.empty() && value.front() == ' ') {
+        value.remove_prefix(1);
+    }
+    while (!value.empty() && value.back() == ' ') {
+        value.remove_suffix(1);
+    }
+    return value;
+}
+
+/// \brief Parse leading integer like std::stol, but without allocation and exceptions
+static bool parse_long(boost::string_view value, long& out) {
+    const bool negative = !value.empty() && value.front() == '-';
+    if (negative) {
+        value.remove_prefix(1);
+    }
+    if (value.empty() || value.front() < '0' || value.front() > '9') {
+        return false;
+    }
+    out = 0;
+    for (size_t i = 0; i < value.size() && value[i] >= '0' && value[i] <= '9'; i++) {
+        if (out > (std::numeric_limits<long>::max() - 9) / 10) {
+            return false;
+        }
+        out = out * 10 + (value[i] - '0');
+    }
+    if (negative) {
+        out = -out;
+    }
+    return true;
+}
+
+// CONNECTION
+httb::connection::connection(net::io_context& ioc, const executor_t& ex, const std::string& host, uint16_t port)
+    : m_ctx(&ioc),
+      m_key(connection_pool::make_key(host, port, false)),
+      m_stream_raw(std::make_unique<plain_stream_t>(ex)) {
+}
+
+httb::connection::connection(net::io_context& ioc, const executor_t& ex, ssl::context& ssl_ctx, const std::string& host, uint16_t port, bool ktls)
+    : m_ctx(&ioc),
+      m_key(connection_pool::make_key(host, port, true)) {
+    if (ktls) {
+        m_stream_ktls = std::make_unique<httb::ktls_stream>(ex, ssl_ctx);
+    } else {
+        m_stream_ssl = std::make_unique<ssl_stream_t>(ex, ssl_ctx);
+    }
+}
+
+httb::connection::~connection() {
+    // stream must die before ssl context it was created with
+    m_stream_ssl.reset();
+    m_stream_ktls.reset();
+    m_stream_raw.reset();
+}
+
+bool httb::connection::is_ssl() const {
+    return m_stream_ssl != nullptr || m_stream_ktls != nullptr;
+}
+
+bool httb::connection::is_ktls() const {
+    return m_stream_ktls != nullptr;
+}
+
+httb::ktls_status httb::connection::ktls_status() const {
+    return is_ktls() ? m_stream_ktls->status() : httb::ktls_status();
+}
+
+bool httb::connection::plain_writes() const {
+    return !is_ssl() || ktls_status().send;
+}
+
+SSL* httb::connection::ssl_handle() {
+    return is_ktls() ? m_stream_ktls->native_handle() : m_stream_ssl->native_handle();
+}
+
+const std::string& httb::connection::key() const {
+    return m_key;
+}
+
+net::io_context& httb::connection::context() {
+    return *m_ctx;
+}
+
+uint64_t httb::connection::uses() const {
+    return m_uses;
+}
+
+httb::connection::plain_stream_t& httb::connection::tcp() {
+    if (is_ktls()) {
+        return m_stream_ktls->next_layer();
+    }
+    return is_ssl() ? m_stream_ssl->next_layer() : *m_stream_raw;
+}
+
+httb::connection::plain_stream_t& httb::connection::plain() {
+    return *m_stream_raw;
+}
+
+httb::connection::ssl_stream_t& httb::connection::ssl() {
+    return *m_stream_ssl;
+}
+
+httb::ktls_stream& httb::connection::ktls() {
+    return *m_stream_ktls;
+}
+
+void httb::connection::expires_after(std::chrono::steady_clock::duration timeout) {
+    tcp().expires_after(timeout);
+    if (is_ktls()) {
+        m_stream_ktls->expires_after(timeout);
+    }
+}
+
+void httb::connection::expires_never() {
+    tcp().expires_never();
+    if (is_ktls()) {
+        m_stream_ktls->expires_never();
+    }
+}
+
+bool httb::connection::is_alive() {
+    auto& sock = tcp().socket();
+    if (!sock.is_open()) {
+        return false;
+    }
+
+    // idle connection must not have anything to read: zero-length read means FIN from server,
+    // any data means garbage or ssl close_notify. Both cases - connection is useless.
+    boost::system::error_code ec;
+    char probe;
+    sock.non_blocking(true, ec);
+    if (ec) {
+        return false;
+    }
+    sock.receive(net::buffer(&probe, 1), net::socket_base::message_peek, ec);
+    const bool alive = ec == net::error::would_block || ec == net::error::try_again;
+    sock.non_blocking(false, ec);
+
+    return alive && !ec;
+}
+
+void httb::connection::close() {
+    boost::system::error_code ec;
+    auto& sock = tcp().socket();
+    if (!sock.is_open()) {
+        return;
+    }
+    if (is_ssl()) {
+        // connection finished gracefully, so its session can be resumed later even without close_notify,
+        // otherwise openssl marks session as non-resumable on SSL_free
+        SSL_set_shutdown(ssl_handle(), SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+    }
+    // Don't shutdown ssl stream - it's bad idea, you will get inifinite waiting for server closing ssl. Close socket directly with no worries
+    sock.shutdown(net::ip::tcp::socket::shutdown_both, ec);
+    sock.close(ec);
+}
+
+void httb::connection::hold_ssl_context(std::shared_ptr<ssl::context> ssl_ctx) {
+    m_ssl_ctx = std::move(ssl_ctx);
+}
+
+// POOL
+std::string httb::connection_pool::make_key(const std::string& host, uint16_t port, bool ssl) {
+    std::string key = ssl ? "https://" : "http://";
+    key += host;
+    key += ":";
+    key += std::to_string(port);
+    return key;
+}
+
+httb::connection_pool::connection_pool() {
+}
+
+httb::connection_pool::~connection_pool() {
+    clear();
+}
+
+std::unique_ptr<httb::connection> httb::connection_pool::acquire(net::io_context& ioc, const std::string& host, uint16_t port, bool ssl) {
+    const std::string key = make_key(host, port, ssl);
+    std::vector<std::unique_ptr<httb::connection>> dead;
+    std::unique_ptr<httb::connection> out;
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    auto it = m_idle.find(key);
+    if (it == m_idle.end()) {
+        return nullptr;
+    }
+
+    auto& list = it->second;
+    evict_expired(list, clock_t::now());
+
+    // most recently used first: it has less chances to be closed by server
+    auto c = list.end();
+    while (c != list.begin()) {
+        --c;
+        if ((*c)->m_ctx != &ioc) {
+            continue;
+        }
+
+        if ((*c)->is_alive()) {
+            out = std::move(*c);
+            list.erase(c);
+            break;
+        }
+
+        m_stats.expired++;
+        (*c)->close();
+        dead.push_back(std::move(*c));
+        c = list.erase(c);
+    }
+
+    recount_idle();
+    if (out) {
+        m_stats.reused++;
+        out->m_uses++;
+    }
+
+    return out;
+}
+
+void httb::connection_pool::release(std::unique_ptr<httb::connection> conn, bool keep_alive, const http::fields& headers) {
+    if (!conn) {
+        return;
+    }
+
+    std::chrono::seconds timeout;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        timeout = m_idle_timeout;
+    }
+
+    // Keep-Alive: timeout=5, max=100
+    const auto ka = headers.find("keep-alive");
+    if (keep_alive && ka != headers.end()) {
+        // parsed in place: it's called for every response
+        boost::string_view params = ka->value();
+        while (!params.empty()) {
+            const size_t comma = params.find(',');
+            const boost::string_view param = params.substr(0, comma);
+            params = comma == boost::string_view::npos ? boost::string_view() : params.substr(comma + 1);
+
+            const size_t eq = param.find('=');
+            if (eq == boost::string_view::npos) {
+                continue;
+            }
+            const boost::string_view name = trim(param.substr(0, eq));
+            long value;
+            if (!parse_long(trim(param.substr(eq + 1)), value)) {
+                // ignore malformed values
+                continue;
+            }
+            if (boost::beast::iequals(name, "timeout")) {
+                timeout = std::min(timeout, std::chrono::seconds(value));
+            } else if (boost::beast::iequals(name, "max") && value <= 0) {
+                keep_alive = false;
+            }
+        }
+    }
+
+    if (!keep_alive || timeout.count() <= 0 || !conn->tcp().socket().is_open()) {
+        conn->close();
+        return;
+    }
+
+    // connections outliving their io_context must be dropped before context destroys socket services
+    net::use_service<connection_pool_service>(static_cast<net::execution_context&>(conn->context())).attach(shared_from_this());
+
+    conn->expires_never();
+    conn->m_expires = clock_t::now() + timeout;
+
+    std::unique_ptr<httb::connection> overflow;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        auto& list = m_idle[conn->key()];
+        list.push_back(std::move(conn));
+        m_stats.released++;
+        if (list.size() > m_max_idle) {
+            overflow = std::move(list.front());
+            overflow->close();
+            list.pop_front();
+            m_stats.expired++;
+        }
+
+        recount_idle();
+    }
+}
+
+void httb::connection_pool::on_created() {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_stats.created++;
+}
+
+void httb::connection_pool::purge(net::execution_context& ctx) {
+    std::vector<std::unique_ptr<httb::connection>> dead;
+    std::lock_guard<std::mutex> lock(m_lock);
+    for (auto& entry : m_idle) {
+        auto& list = entry.second;
+        for (auto it = list.begin(); it != list.end();) {
+            if (static_cast<net::execution_context*>((*it)->m_ctx) == &ctx) {
+                (*it)->close();
+                dead.push_back(std::move(*it));
+                it = list.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    recount_idle();
+}
+
+void httb::connection_pool::clear() {
+    std::lock_guard<std::mutex> lock(m_lock);
+    for (auto& entry : m_idle) {
+        for (auto& c : entry.second) {
+            c->close();
+        }
+    }
+    m_idle.clear();
+    m_stats.idle = 0;
+}
+
+void httb::connection_pool::set_idle_timeout(std::chrono::seconds timeout) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_idle_timeout = timeout;
+}
+
+void httb::connection_pool::set_max_idle(size_t max_per_host) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_max_idle = max_per_host;
+}
+
+httb::connection_stats httb::connection_pool::stats() const {
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_stats;
+}
+
+void httb::connection_pool::evict_expired(std::deque<std::unique_ptr<httb::connection>>& list, clock_t::time_point now) {
+    // entries are ordered by release time, but timeouts may differ per response, so check all of them
+    list.erase(std::remove_if(list.begin(), list.end(), [this, now](const std::unique_ptr<httb::connection>& c) {
+                   if (c->m_expires <= now) {
+                       c->close();
+                       m_stats.expired++;
+                       return true;
+                   }
+                   return false;
+               }),
+               list.end());
+}
+
+void httb::connection_pool::recount_idle() {
+    m_stats.idle = 0;
+    for (const auto& entry : m_idle) {
+        m_stats.idle += entry.second.size();
+    }
+}
+
+// SERVICE
+net::execution_context::id httb::connection_pool_service::id;
+
+httb::connection_pool_service::connection_pool_service(net::execution_context& ctx)
+    : net::execution_context::service(ctx) {
+}
+
+void httb::connection_pool_service::attach(const std::shared_ptr<connection_pool>& pool) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_pools.erase(std::remove_if(m_pools.begin(), m_pools.end(), [](const std::weak_ptr<connection_pool>& p) {
+                      return p.expired();
+                  }),
+                  m_pools.end());
+
+    for (const auto& p : m_pools) {
+        if (p.lock() == pool) {
+            return;
+        }
+    }
+    m_pools.push_back(pool);
+}
+
+void httb::connection_pool_service::shutdown() {
+    std::vector<std::weak_ptr<connection_pool>> pools;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        pools.swap(m_pools);
+    }
+
+    for (auto& p : pools) {
+        if (auto pool = p.lock()) {
+            pool->purge(context());
+        }
+    }
+}
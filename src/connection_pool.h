@@ -0,0 +1,175 @@
+/*!
+ * httb.
+ * connection_pool.h
+ *
+ * \date 2019
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+#ifndef HTTB_CONNECTION_POOL_H
+#define HTTB_CONNECTION_POOL_H
+
+#include "httb/client.h"
+#include "ktls_stream.h"
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/ssl/context.hpp>
+#include <boost/beast/core/tcp_stream.hpp>
+#include <boost/beast/http/fields.hpp>
+#include <boost/beast/ssl/ssl_stream.hpp>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace httb {
+
+namespace beast = boost::beast;
+namespace http = boost::beast::http;
+namespace ssl = boost::asio::ssl;
+
+/// \brief Single plain, ssl or kernel TLS connection. Connection is bound to io_context it was created with,
+/// so it can be reused only by requests executing in the same context.
+class connection {
+public:
+    using plain_stream_t = beast::tcp_stream;
+    using ssl_stream_t = beast::ssl_stream<beast::tcp_stream>;
+    using executor_t = beast::tcp_stream::executor_type;
+
+    /// \brief Create plain tcp connection
+    /// \param ioc context this connection belongs to
+    /// \param ex executor for stream handlers
+    /// \param host remote host name
+    /// \param port remote port
+    connection(net::io_context& ioc, const executor_t& ex, const std::string& host, uint16_t port);
+
+    /// \brief Create ssl connection
+    /// \param ioc context this connection belongs to
+    /// \param ex executor for stream handlers
+    /// \param ssl_ctx ssl context, must outlive connection
+    /// \param host remote host name
+    /// \param port remote port
+    /// \param ktls use ktls_stream, to let kernel encrypt records if possible
+    connection(net::io_context& ioc, const executor_t& ex, ssl::context& ssl_ctx, const std::string& host, uint16_t port, bool ktls = false);
+    virtual ~connection();
+
+    /// \brief Connection is encrypted, by ssl or ktls stream
+    bool is_ssl() const;
+    bool is_ktls() const;
+    /// \brief Kernel TLS offload state, nothing is offloaded for non-ktls connections
+    httb::ktls_status ktls_status() const;
+    /// \brief Request bytes can be written right to socket: connection is plain or kernel encrypts sent records
+    bool plain_writes() const;
+    /// \brief Native handle of ssl or ktls stream
+    SSL* ssl_handle();
+    const std::string& key() const;
+    net::io_context& context();
+
+    /// \brief How many requests were sent over this connection
+    uint64_t uses() const;
+
+    /// \brief Lowest layer stream
+    plain_stream_t& tcp();
+    plain_stream_t& plain();
+    ssl_stream_t& ssl();
+    httb::ktls_stream& ktls();
+
+    /// \brief Timeout of next operations, for any stream type
+    void expires_after(std::chrono::steady_clock::duration timeout);
+    void expires_never();
+
+    /// \brief Check socket still open and peer did not send anything (FIN or garbage) while connection was idle
+    bool is_alive();
+
+    /// \brief Shutdown and close socket, errors are ignored
+    void close();
+
+    /// \brief Keep ssl context alive while connection exists
+    void hold_ssl_context(std::shared_ptr<ssl::context> ssl_ctx);
+
+private:
+    friend class connection_pool;
+    net::io_context* m_ctx;
+    std::string m_key;
+    std::shared_ptr<ssl::context> m_ssl_ctx;
+    std::unique_ptr<plain_stream_t> m_stream_raw;
+    std::unique_ptr<ssl_stream_t> m_stream_ssl;
+    std::unique_ptr<httb::ktls_stream> m_stream_ktls;
+    std::chrono::steady_clock::time_point m_expires;
+    uint64_t m_uses = 0;
+};
+
+/// \brief Keep-alive connection pool, keyed by (host, port, ssl).
+/// Idle connections are dropped by timeout, by server "Keep-Alive" limits, or when their io_context is destroyed.
+class connection_pool : public std::enable_shared_from_this<connection_pool> {
+public:
+    using clock_t = std::chrono::steady_clock;
+
+    static std::string make_key(const std::string& host, uint16_t port, bool ssl);
+
+    connection_pool();
+    virtual ~connection_pool();
+
+    /// \brief Take idle live connection for host. Only connections opened on same context are returned
+    /// \param ioc context where connection will be used
+    /// \param host
+    /// \param port
+    /// \param ssl
+    /// \return nullptr if there is no idle connection
+    std::unique_ptr<httb::connection> acquire(net::io_context& ioc, const std::string& host, uint16_t port, bool ssl);
+
+    /// \brief Return connection after completed exchange. If keep_alive is false, connection will be closed
+    /// \param conn connection
+    /// \param keep_alive both sides agreed to keep connection alive and message did not require eof
+    /// \param headers response headers, used to read "Keep-Alive: timeout=N, max=M"
+    void release(std::unique_ptr<httb::connection> conn, bool keep_alive, const http::fields& headers);
+
+    /// \brief Count newly opened connection
+    void on_created();
+
+    /// \brief Drop all idle connections bound to context
+    /// \param ctx context which is shutting down
+    void purge(net::execution_context& ctx);
+
+    /// \brief Drop all idle connections
+    void clear();
+
+    void set_idle_timeout(std::chrono::seconds timeout);
+    void set_max_idle(size_t max_per_host);
+
+    httb::connection_stats stats() const;
+
+private:
+    mutable std::mutex m_lock;
+    std::unordered_map<std::string, std::deque<std::unique_ptr<httb::connection>>> m_idle;
+    std::chrono::seconds m_idle_timeout = 30s;
+    size_t m_max_idle = 8;
+    httb::connection_stats m_stats;
+
+    void evict_expired(std::deque<std::unique_ptr<httb::connection>>& list, clock_t::time_point now);
+    void recount_idle();
+};
+
+/// \brief Per-io_context service: drops pooled connections bound to context before its socket services are destroyed
+class connection_pool_service : public net::execution_context::service {
+public:
+    static net::execution_context::id id;
+
+    explicit connection_pool_service(net::execution_context& ctx);
+    void attach(const std::shared_ptr<connection_pool>& pool);
+
+private:
+    std::mutex m_lock;
+    std::vector<std::weak_ptr<connection_pool>> m_pools;
+
+    void shutdown() override;
+};
+
+} // namespace httb
+
+#endif //HTTB_CONNECTION_POOL_H
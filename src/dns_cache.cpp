@@ -0,0 +1,216 @@
+/*!
+ * httb.
+ * dns_cache.cpp
+ *
+ * \date 2019
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+#include "dns_cache.h"
+
+#include <boost/asio/post.hpp>
+
+httb::dns_cache::dns_cache() {
+}
+
+httb::dns_cache::~dns_cache() {
+    m_work.reset();
+    m_ctx.stop();
+    if (m_worker.joinable()) {
+        m_worker.join();
+    }
+}
+
+httb::endpoints_t httb::dns_cache::resolve(const std::string& host, const std::string& port, boost::system::error_code& ec) {
+    const std::string key = make_key(host, port);
+    httb::endpoints_t out;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (lookup(key, clock_t::now(), out, ec)) {
+            return out;
+        }
+    }
+
+    net::ip::tcp::resolver resolver(m_ctx);
+    const auto results = resolver.resolve(host, port, ec);
+    for (const auto& entry : results) {
+        out.push_back(entry.endpoint());
+    }
+    store(key, ec, out);
+
+    return out;
+}
+
+void httb::dns_cache::async_resolve(const net::executor& ex, const std::string& host, const std::string& port, resolve_func_t handler) {
+    const std::string key = make_key(host, port);
+    httb::endpoints_t out;
+    boost::system::error_code ec;
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (lookup(key, clock_t::now(), out, ec)) {
+        net::post(ex, [handler, ec, out]() {
+            handler(ec, out);
+        });
+        return;
+    }
+
+    auto& e = m_entries[key];
+    e.waiters.emplace_back(net::make_work_guard(ex), std::move(handler));
+    if (!e.pending) {
+        e.pending = true;
+        start_async(key, host, port);
+    }
+}
+
+void httb::dns_cache::set_ttl(std::chrono::seconds positive, std::chrono::seconds negative) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_ttl = positive;
+    m_negative_ttl = negative;
+}
+
+void httb::dns_cache::set_enabled(bool enabled) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_enabled = enabled;
+}
+
+void httb::dns_cache::add_override(const std::string& host, uint16_t port, const std::string& address) {
+    net::ip::tcp::endpoint endpoint(net::ip::make_address(address), port);
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_overrides[make_key(host, std::to_string(port))].push_back(std::move(endpoint));
+}
+
+void httb::dns_cache::clear_overrides() {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_overrides.clear();
+}
+
+void httb::dns_cache::clear() {
+    std::lock_guard<std::mutex> lock(m_lock);
+    // keep in-flight lookups: their waiters must be notified
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        if (it->second.pending) {
+            ++it;
+        } else {
+            it = m_entries.erase(it);
+        }
+    }
+}
+
+httb::dns_stats httb::dns_cache::stats() const {
+    std::lock_guard<std::mutex> lock(m_lock);
+    httb::dns_stats out = m_stats;
+    out.entries = m_entries.size();
+    return out;
+}
+
+std::string httb::dns_cache::make_key(const std::string& host, const std::string& port) {
+    return host + ":" + port;
+}
+
+bool httb::dns_cache::is_cacheable_error(boost::system::error_code ec) {
+    // only definite answers, temporary failures should be retried by next request
+    return ec == net::error::host_not_found ||
+           ec == net::error::no_data ||
+           ec == net::error::service_not_found;
+}
+
+bool httb::dns_cache::lookup(const std::string& key, clock_t::time_point now, httb::endpoints_t& out, boost::system::error_code& ec) {
+    const auto ov = m_overrides.find(key);
+    if (ov != m_overrides.end()) {
+        out = ov->second;
+        ec = {};
+        m_stats.hits++;
+        return true;
+    }
+
+    if (!m_enabled) {
+        m_stats.misses++;
+        return false;
+    }
+
+    auto it = m_entries.find(key);
+    if (it == m_entries.end() || it->second.expires <= now) {
+        m_stats.misses++;
+        return false;
+    }
+
+    entry& e = it->second;
+    if (e.ec) {
+        m_stats.negative_hits++;
+    } else {
+        m_stats.hits++;
+    }
+
+    out = e.endpoints;
+    ec = e.ec;
+
+    // refresh ahead: update entry in background before it expires, so requests never wait for lookup
+    if (!e.ec && !e.pending && e.refresh_at <= now) {
+        e.pending = true;
+        m_stats.refreshes++;
+        const auto sep = key.rfind(':');
+        start_async(key, key.substr(0, sep), key.substr(sep + 1));
+    }
+
+    return true;
+}
+
+void httb::dns_cache::store(const std::string& key, const boost::system::error_code& ec, const httb::endpoints_t& endpoints) {
+    std::vector<std::pair<net::executor_work_guard<net::executor>, resolve_func_t>> waiters;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        const auto now = clock_t::now();
+        entry& e = m_entries[key];
+        waiters.swap(e.waiters);
+        e.pending = false;
+
+        if (!ec) {
+            e.endpoints = endpoints;
+            e.ec = {};
+            e.expires = now + m_ttl;
+            e.refresh_at = now + m_ttl * 4 / 5;
+        } else if (is_cacheable_error(ec)) {
+            e.endpoints.clear();
+            e.ec = ec;
+            e.expires = now + m_negative_ttl;
+            e.refresh_at = e.expires;
+        }
+
+        if (!m_enabled || e.expires <= now) {
+            m_entries.erase(key);
+        }
+    }
+
+    for (auto& waiter : waiters) {
+        auto handler = std::move(waiter.second);
+        net::post(waiter.first.get_executor(), [handler, ec, endpoints]() {
+            handler(ec, endpoints);
+        });
+    }
+}
+
+void httb::dns_cache::start_async(const std::string& key, const std::string& host, const std::string& port) {
+    ensure_worker();
+
+    auto resolver = std::make_shared<net::ip::tcp::resolver>(m_ctx);
+    resolver->async_resolve(host, port, [this, resolver, key](boost::system::error_code ec, net::ip::tcp::resolver::results_type results) {
+        httb::endpoints_t endpoints;
+        for (const auto& entry : results) {
+            endpoints.push_back(entry.endpoint());
+        }
+        store(key, ec, endpoints);
+    });
+}
+
+void httb::dns_cache::ensure_worker() {
+    if (m_worker.joinable()) {
+        return;
+    }
+
+    m_work = std::make_unique<net::executor_work_guard<net::io_context::executor_type>>(m_ctx.get_executor());
+    m_worker = std::thread([this]() {
+        m_ctx.run();
+    });
+}
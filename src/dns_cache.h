@@ -0,0 +1,111 @@
+/*!
+ * httb.
+ * dns_cache.h
+ *
+ * \date 2019
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+#ifndef HTTB_DNS_CACHE_H
+#define HTTB_DNS_CACHE_H
+
+#include "httb/client.h"
+
+#include <boost/asio/executor.hpp>
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/system/error_code.hpp>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace httb {
+
+using endpoints_t = std::vector<boost::asio::ip::tcp::endpoint>;
+
+/// \brief Thread-safe resolver cache with positive and negative TTL, refresh-ahead and static overrides (like curl --resolve).
+/// Async resolving runs on cache own background thread, so callers' io_context never waits for getaddrinfo.
+class dns_cache {
+public:
+    using clock_t = std::chrono::steady_clock;
+    using resolve_func_t = std::function<void(boost::system::error_code, httb::endpoints_t)>;
+
+    dns_cache();
+    virtual ~dns_cache();
+
+    /// \brief Blocking resolve
+    /// \param host
+    /// \param port
+    /// \param ec resolve error (may be cached)
+    /// \return resolved endpoints
+    httb::endpoints_t resolve(const std::string& host, const std::string& port, boost::system::error_code& ec);
+
+    /// \brief Async resolve. Concurrent lookups of the same host are coalesced to one getaddrinfo call
+    /// \param ex executor to call handler on
+    /// \param host
+    /// \param port
+    /// \param handler
+    void async_resolve(const net::executor& ex, const std::string& host, const std::string& port, resolve_func_t handler);
+
+    /// \brief Set how long to keep results
+    /// \param positive successful lookups ttl
+    /// \param negative failed lookups ttl
+    void set_ttl(std::chrono::seconds positive, std::chrono::seconds negative);
+
+    /// \brief Enable or disable caching. Overrides work anyway
+    void set_enabled(bool enabled);
+
+    /// \brief Add static address for host and port, multiple addresses can be added
+    /// \param host
+    /// \param port
+    /// \param address ip v4 or v6 address
+    void add_override(const std::string& host, uint16_t port, const std::string& address);
+    void clear_overrides();
+
+    /// \brief Drop all cached lookups
+    void clear();
+
+    httb::dns_stats stats() const;
+
+private:
+    struct entry {
+        httb::endpoints_t endpoints;
+        boost::system::error_code ec;
+        clock_t::time_point expires;
+        clock_t::time_point refresh_at;
+        bool pending = false;
+        /// \brief work guard keeps caller's context running while lookup is in progress on cache thread
+        std::vector<std::pair<net::executor_work_guard<net::executor>, resolve_func_t>> waiters;
+    };
+
+    static std::string make_key(const std::string& host, const std::string& port);
+    static bool is_cacheable_error(boost::system::error_code ec);
+
+    mutable std::mutex m_lock;
+    std::unordered_map<std::string, entry> m_entries;
+    std::unordered_map<std::string, httb::endpoints_t> m_overrides;
+    std::chrono::seconds m_ttl = 60s;
+    std::chrono::seconds m_negative_ttl = 5s;
+    bool m_enabled = true;
+    httb::dns_stats m_stats;
+
+    net::io_context m_ctx;
+    std::unique_ptr<net::executor_work_guard<net::io_context::executor_type>> m_work;
+    std::thread m_worker;
+
+    bool lookup(const std::string& key, clock_t::time_point now, httb::endpoints_t& out, boost::system::error_code& ec);
+    void store(const std::string& key, const boost::system::error_code& ec, const httb::endpoints_t& endpoints);
+    void start_async(const std::string& key, const std::string& host, const std::string& port);
+    void ensure_worker();
+};
+
+} // namespace httb
+
+#endif //HTTB_DNS_CACHE_H
@@ -0,0 +1,102 @@
+/*!
+ * httb.
+ * event_loop.cpp
+ *
+ * \date 2019
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+#include "event_loop.h"
+
+httb::mpsc_queue::mpsc_queue()
+    : m_head(&m_stub),
+      m_tail(&m_stub) {
+}
+
+void httb::mpsc_queue::push(node* item) {
+    item->next.store(nullptr, std::memory_order_relaxed);
+    node* prev = m_head.exchange(item, std::memory_order_acq_rel);
+    // between exchange and this store consumer sees queue as empty
+    prev->next.store(item, std::memory_order_release);
+}
+
+httb::mpsc_queue::node* httb::mpsc_queue::pop() {
+    node* tail = m_tail;
+    node* next = tail->next.load(std::memory_order_acquire);
+    if (tail == &m_stub) {
+        if (!next) {
+            return nullptr;
+        }
+        m_tail = next;
+        tail = next;
+        next = next->next.load(std::memory_order_acquire);
+    }
+    if (next) {
+        m_tail = next;
+        return tail;
+    }
+    if (tail != m_head.load(std::memory_order_acquire)) {
+        // producer is in the middle of push
+        return nullptr;
+    }
+    // tail is the last node: put stub behind it to be able to take it
+    push(&m_stub);
+    next = tail->next.load(std::memory_order_acquire);
+    if (next) {
+        m_tail = next;
+        return tail;
+    }
+    return nullptr;
+}
+
+httb::event_loop::event_loop(size_t threads)
+    : m_pool(threads),
+      m_next(0) {
+    m_loops.reserve(m_pool.size());
+    for (size_t i = 0; i < m_pool.size(); i++) {
+        m_loops.push_back(std::make_unique<loop>());
+    }
+    m_pool.start();
+}
+
+httb::event_loop::~event_loop() {
+    m_pool.stop_when_idle();
+    for (size_t i = 0; i < m_pool.size(); i++) {
+        m_pool.get(i).stop();
+    }
+    m_pool.join();
+
+    for (auto& item : m_loops) {
+        while (mpsc_queue::node* node = item->queue.pop()) {
+            delete static_cast<task_node*>(node);
+        }
+    }
+}
+
+size_t httb::event_loop::size() const {
+    return m_pool.size();
+}
+
+void httb::event_loop::submit(task_func task) {
+    const size_t idx = m_next.fetch_add(1, std::memory_order_relaxed) % m_loops.size();
+    loop& target = *m_loops[idx];
+    target.queue.push(new task_node(std::move(task)));
+    if (!target.scheduled.exchange(true)) {
+        net::post(m_pool.get(idx), [this, idx]() {
+            drain(idx);
+        });
+    }
+}
+
+void httb::event_loop::drain(size_t idx) {
+    loop& target = *m_loops[idx];
+    // reset before draining: task pushed after last pop() schedules new drain
+    target.scheduled.store(false);
+
+    net::io_context& ioc = m_pool.get(idx);
+    while (mpsc_queue::node* node = target.queue.pop()) {
+        std::unique_ptr<task_node> item(static_cast<task_node*>(node));
+        item->task(ioc);
+    }
+}
@@ -0,0 +1,91 @@
+/*!
+ * httb.
+ * event_loop.h
+ *
+ * \date 2019
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+#ifndef HTTB_EVENT_LOOP_H
+#define HTTB_EVENT_LOOP_H
+
+#include "httb/client.h"
+#include "io_context_pool.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace httb {
+
+/// \brief Intrusive lock-free multi-producer single-consumer queue (Vyukov). push() is wait-free and may be called
+/// from any thread, pop() must be called by single consumer. Queue doesn't own nodes
+class mpsc_queue {
+public:
+    struct node {
+        std::atomic<node*> next{nullptr};
+    };
+
+    mpsc_queue();
+    mpsc_queue(const mpsc_queue&) = delete;
+    mpsc_queue& operator=(const mpsc_queue&) = delete;
+
+    void push(node* item);
+
+    /// \brief Take oldest node
+    /// \return nullptr if queue is empty or producer has not finished push yet
+    node* pop();
+
+private:
+    std::atomic<node*> m_head;
+    node* m_tail;
+    node m_stub;
+};
+
+/// \brief Long-lived set of event loop threads owned by client. Tasks submitted from any thread are distributed
+/// round-robin over loops through lock-free queues: producer posts to io_context only when queue becomes non-empty,
+/// so burst of submissions costs single wake-up of loop thread.
+class event_loop {
+public:
+    /// \brief Task, called on loop thread with its context
+    using task_func = std::function<void(net::io_context&)>;
+
+    /// \brief Start threads
+    /// \param threads number of loop threads, at least 1
+    explicit event_loop(size_t threads);
+
+    /// \brief Stops loops and joins threads. Not started tasks are dropped
+    virtual ~event_loop();
+
+    size_t size() const;
+
+    /// \brief Submit task. Thread-safe
+    /// \param task
+    void submit(task_func task);
+
+private:
+    struct task_node : mpsc_queue::node {
+        explicit task_node(task_func&& fn)
+            : task(std::move(fn)) {
+        }
+        task_func task;
+    };
+
+    struct loop {
+        mpsc_queue queue;
+        /// \brief drain has been posted and not started yet
+        std::atomic<bool> scheduled{false};
+    };
+
+    httb::io_context_pool m_pool;
+    std::vector<std::unique_ptr<loop>> m_loops;
+    std::atomic<size_t> m_next;
+
+    void drain(size_t idx);
+};
+
+} // namespace httb
+
+#endif //HTTB_EVENT_LOOP_H
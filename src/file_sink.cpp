@@ -0,0 +1,124 @@
+/*!
+ * httb.
+ * file_sink.cpp
+ *
+ * \date 2019
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+#include "file_sink.h"
+
+#include <boost/align/aligned_alloc.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <new>
+
+#ifdef __linux__
+#include <fcntl.h>
+#endif
+
+const size_t httb::file_sink::ALIGNMENT;
+const size_t httb::file_sink::DEFAULT_BUFFER_SIZE;
+
+void httb::file_sink::aligned_deleter::operator()(char* ptr) const {
+    boost::alignment::aligned_free(ptr);
+}
+
+httb::file_sink::file_sink(size_t bufferSize)
+    : m_capacity(std::max<size_t>(1, (bufferSize + ALIGNMENT - 1) / ALIGNMENT) * ALIGNMENT) {
+}
+
+httb::file_sink::~file_sink() {
+    boost::system::error_code ec;
+    if (m_file.is_open()) {
+        m_file.close(ec);
+    }
+}
+
+void httb::file_sink::open(const std::string& path, boost::system::error_code& ec) {
+    if (!m_buffer) {
+        m_buffer.reset(static_cast<char*>(boost::alignment::aligned_alloc(ALIGNMENT, m_capacity)));
+        if (!m_buffer) {
+            throw std::bad_alloc();
+        }
+    }
+    m_path = path;
+    m_used = 0;
+    m_size = 0;
+    m_file.open(path.c_str(), boost::beast::file_mode::write, ec);
+}
+
+bool httb::file_sink::is_open() const {
+    return m_file.is_open();
+}
+
+void httb::file_sink::preallocate(uint64_t size, boost::system::error_code& ec) {
+    ec = {};
+    if (!m_file.is_open() || size == 0) {
+        return;
+    }
+#if defined(__linux__) && BOOST_BEAST_USE_POSIX_FILE
+    // keep size: interrupted download doesn't look complete
+    int ret;
+    do {
+        ret = ::fallocate(m_file.native_handle(), FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(size));
+    } while (ret != 0 && errno == EINTR);
+    // reservation is best effort only where it's not supported, no space or too large file fails download right away
+    if (ret != 0 && errno != EOPNOTSUPP && errno != ENOSYS) {
+        ec = boost::system::error_code(errno, boost::system::system_category());
+    }
+#endif
+}
+
+void httb::file_sink::write(const char* data, size_t size, boost::system::error_code& ec) {
+    m_size += size;
+    while (size > 0) {
+        const size_t n = std::min(size, m_capacity - m_used);
+        std::memcpy(m_buffer.get() + m_used, data, n);
+        m_used += n;
+        data += n;
+        size -= n;
+        if (m_used == m_capacity) {
+            flush(ec);
+            if (ec) {
+                return;
+            }
+        }
+    }
+}
+
+void httb::file_sink::close(boost::system::error_code& ec) {
+    flush(ec);
+    if (ec) {
+        return;
+    }
+    m_file.close(ec);
+}
+
+void httb::file_sink::discard() {
+    if (!m_file.is_open()) {
+        return;
+    }
+    boost::system::error_code ec;
+    m_file.close(ec);
+    std::remove(m_path.c_str());
+}
+
+uint64_t httb::file_sink::size() const {
+    return m_size;
+}
+
+void httb::file_sink::flush(boost::system::error_code& ec) {
+    size_t offset = 0;
+    while (offset < m_used) {
+        const size_t written = m_file.write(m_buffer.get() + offset, m_used - offset, ec);
+        if (ec) {
+            return;
+        }
+        offset += written;
+    }
+    m_used = 0;
+}
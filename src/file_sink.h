@@ -0,0 +1,75 @@
+/*!
+ * httb.
+ * file_sink.h
+ *
+ * \date 2019
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+#ifndef HTTB_FILE_SINK_H
+#define HTTB_FILE_SINK_H
+
+#include <boost/beast/core/file.hpp>
+#include <boost/system/error_code.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace httb {
+
+/// \brief Write-only file for downloads: data is collected into fixed aligned buffer and written by whole buffers,
+/// so every write (except the last one) has the same large size and starts at offset aligned to block size.
+/// Memory usage doesn't depend on file size
+class file_sink {
+public:
+    /// \brief Block size writes are aligned to
+    static const size_t ALIGNMENT = 4096;
+    static const size_t DEFAULT_BUFFER_SIZE = 1024 * 1024;
+
+    /// \param bufferSize size of single write, rounded up to ALIGNMENT
+    explicit file_sink(size_t bufferSize = DEFAULT_BUFFER_SIZE);
+    file_sink(const file_sink&) = delete;
+    file_sink& operator=(const file_sink&) = delete;
+    /// \brief Closes file without flushing buffer
+    ~file_sink();
+
+    /// \brief Create file or truncate existing
+    void open(const std::string& path, boost::system::error_code& ec);
+    bool is_open() const;
+
+    /// \brief Reserve disk space for expected size (Linux fallocate, file size is not changed), so file is not
+    /// fragmented and "no space" error happens before download. Does nothing if not supported by system or file system
+    /// \param size
+    /// \param ec allocation error, like no space or too large file
+    void preallocate(uint64_t size, boost::system::error_code& ec);
+
+    void write(const char* data, size_t size, boost::system::error_code& ec);
+
+    /// \brief Flush buffer and close file
+    void close(boost::system::error_code& ec);
+
+    /// \brief Close and remove incomplete file
+    void discard();
+
+    /// \brief Bytes passed to write()
+    uint64_t size() const;
+
+private:
+    struct aligned_deleter {
+        void operator()(char* ptr) const;
+    };
+
+    boost::beast::file m_file;
+    std::string m_path;
+    std::unique_ptr<char, aligned_deleter> m_buffer;
+    size_t m_capacity;
+    size_t m_used = 0;
+    uint64_t m_size = 0;
+
+    void flush(boost::system::error_code& ec);
+};
+
+} // namespace httb
+
+#endif //HTTB_FILE_SINK_H
@@ -0,0 +1,163 @@
+/*!
+ * httb.
+ * happy_eyeballs.cpp
+ *
+ * \date 2019
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+#include "happy_eyeballs.h"
+
+#include <boost/asio/post.hpp>
+#include <boost/beast/core/error.hpp>
+
+httb::endpoints_t httb::happy_eyeballs_connector::sort_endpoints(const httb::endpoints_t& endpoints) {
+    if (endpoints.empty()) {
+        return endpoints;
+    }
+
+    httb::endpoints_t preferred, other;
+    const bool v6First = endpoints.front().address().is_v6();
+    for (const auto& ep : endpoints) {
+        if (ep.address().is_v6() == v6First) {
+            preferred.push_back(ep);
+        } else {
+            other.push_back(ep);
+        }
+    }
+
+    httb::endpoints_t out;
+    out.reserve(endpoints.size());
+    for (size_t i = 0; i < std::max(preferred.size(), other.size()); i++) {
+        if (i < preferred.size()) {
+            out.push_back(preferred[i]);
+        }
+        if (i < other.size()) {
+            out.push_back(other[i]);
+        }
+    }
+
+    return out;
+}
+
+httb::happy_eyeballs_connector::happy_eyeballs_connector(const net::executor& ex,
+                                                         const httb::endpoints_t& endpoints,
+                                                         std::chrono::milliseconds attempt_delay,
+                                                         std::chrono::steady_clock::duration timeout)
+    : m_executor(ex),
+      m_endpoints(sort_endpoints(endpoints)),
+      m_attempt_delay(attempt_delay),
+      m_delay_timer(ex),
+      m_deadline(ex) {
+    m_deadline.expires_after(timeout);
+}
+
+httb::happy_eyeballs_connector::~happy_eyeballs_connector() {
+}
+
+void httb::happy_eyeballs_connector::run(connect_func_t handler) {
+    m_handler = std::move(handler);
+
+    if (m_endpoints.empty()) {
+        auto self = shared_from_this();
+        net::post(m_executor, [self]() {
+            self->finish(net::error::host_not_found, nullptr);
+        });
+        return;
+    }
+
+    m_deadline.async_wait(std::bind(&happy_eyeballs_connector::on_deadline, shared_from_this(), std::placeholders::_1));
+    start_next();
+}
+
+void httb::happy_eyeballs_connector::cancel() {
+    if (!m_done) {
+        finish(net::error::operation_aborted, nullptr);
+    }
+}
+
+void httb::happy_eyeballs_connector::start_next() {
+    if (m_done || m_next >= m_endpoints.size()) {
+        return;
+    }
+
+    const size_t idx = m_next++;
+    m_attempts.push_back(std::make_unique<socket_t>(m_executor));
+    m_attempts[idx]->async_connect(m_endpoints[idx],
+                                   std::bind(&happy_eyeballs_connector::on_attempt,
+                                             shared_from_this(),
+                                             idx,
+                                             std::placeholders::_1));
+
+    if (m_next < m_endpoints.size()) {
+        // re-arming cancels previous wait
+        m_delay_timer.expires_after(m_attempt_delay);
+        m_delay_timer.async_wait(std::bind(&happy_eyeballs_connector::on_delay, shared_from_this(), std::placeholders::_1));
+    }
+}
+
+void httb::happy_eyeballs_connector::on_attempt(size_t idx, boost::system::error_code ec) {
+    if (m_done) {
+        return;
+    }
+
+    if (!ec) {
+        finish({}, m_attempts[idx].get());
+        return;
+    }
+
+    m_last_error = ec;
+    m_failed++;
+    boost::system::error_code ignored;
+    m_attempts[idx]->close(ignored);
+
+    if (m_failed == m_endpoints.size()) {
+        finish(m_last_error, nullptr);
+        return;
+    }
+
+    // attempt failed before delay passed: no reason to wait, start next one right now
+    start_next();
+}
+
+void httb::happy_eyeballs_connector::on_delay(boost::system::error_code ec) {
+    if (ec || m_done) {
+        return;
+    }
+    start_next();
+}
+
+void httb::happy_eyeballs_connector::on_deadline(boost::system::error_code ec) {
+    if (ec == net::error::operation_aborted || m_done) {
+        return;
+    }
+    finish(boost::beast::error::timeout, nullptr);
+}
+
+void httb::happy_eyeballs_connector::finish(boost::system::error_code ec, socket_t* winner) {
+    m_done = true;
+    m_delay_timer.cancel();
+    m_deadline.cancel();
+
+    // losers complete with operation_aborted
+    boost::system::error_code ignored;
+    for (auto& attempt : m_attempts) {
+        if (attempt.get() != winner) {
+            attempt->close(ignored);
+        }
+    }
+
+    auto handler = std::move(m_handler);
+    m_handler = nullptr;
+    if (!handler) {
+        return;
+    }
+
+    if (winner) {
+        handler(ec, *winner);
+    } else {
+        socket_t empty(m_executor);
+        handler(ec, empty);
+    }
+}
@@ -0,0 +1,79 @@
+/*!
+ * httb.
+ * happy_eyeballs.h
+ *
+ * \date 2019
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+#ifndef HTTB_HAPPY_EYEBALLS_H
+#define HTTB_HAPPY_EYEBALLS_H
+
+#include "dns_cache.h"
+
+#include <boost/asio/steady_timer.hpp>
+#include <boost/beast/core/tcp_stream.hpp>
+#include <boost/system/error_code.hpp>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace httb {
+
+/// \brief RFC 8305 connection racing: endpoints are interleaved by address family and connection attempts
+/// are started with a small delay one after another without waiting previous to fail.
+/// First connected socket wins, other attempts are cancelled.
+/// Not thread-safe: all handlers must run on single executor (strand).
+class happy_eyeballs_connector : public std::enable_shared_from_this<happy_eyeballs_connector> {
+public:
+    using socket_t = boost::beast::tcp_stream::socket_type;
+    using connect_func_t = std::function<void(boost::system::error_code, socket_t&)>;
+
+    /// \brief Interleave ipv6 and ipv4 endpoints, starting from family of the first (preferred by resolver) endpoint
+    /// \param endpoints resolver results
+    /// \return reordered endpoints
+    static httb::endpoints_t sort_endpoints(const httb::endpoints_t& endpoints);
+
+    /// \brief
+    /// \param ex executor for sockets and timers
+    /// \param endpoints resolved endpoints
+    /// \param attempt_delay delay before next attempt, if previous did not complete (RFC recommends 250ms)
+    /// \param timeout whole connect phase timeout
+    happy_eyeballs_connector(const net::executor& ex,
+                             const httb::endpoints_t& endpoints,
+                             std::chrono::milliseconds attempt_delay,
+                             std::chrono::steady_clock::duration timeout);
+    virtual ~happy_eyeballs_connector();
+
+    /// \brief Start racing
+    /// \param handler called once with connected socket or with last error
+    void run(connect_func_t handler);
+
+    /// \brief Abort all attempts, handler will be called with operation_aborted
+    void cancel();
+
+private:
+    net::executor m_executor;
+    httb::endpoints_t m_endpoints;
+    std::chrono::milliseconds m_attempt_delay;
+    std::vector<std::unique_ptr<socket_t>> m_attempts;
+    net::steady_timer m_delay_timer;
+    net::steady_timer m_deadline;
+    connect_func_t m_handler;
+    size_t m_next = 0;
+    size_t m_failed = 0;
+    bool m_done = false;
+    boost::system::error_code m_last_error;
+
+    void start_next();
+    void on_attempt(size_t idx, boost::system::error_code ec);
+    void on_delay(boost::system::error_code ec);
+    void on_deadline(boost::system::error_code ec);
+    void finish(boost::system::error_code ec, socket_t* winner);
+};
+
+} // namespace httb
+
+#endif //HTTB_HAPPY_EYEBALLS_H
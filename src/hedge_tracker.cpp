@@ -0,0 +1,109 @@
+/*!
+ * httb.
+ * hedge_tracker.cpp
+ *
+ * \date 2019
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+#include "hedge_tracker.h"
+
+#include <algorithm>
+
+const size_t httb::hedge_tracker::SAMPLES_WINDOW;
+const size_t httb::hedge_tracker::MIN_SAMPLES;
+const double httb::hedge_tracker::MAX_TOKENS = 10;
+
+httb::hedge_tracker::hedge_tracker() {
+}
+
+httb::hedge_tracker::~hedge_tracker() {
+}
+
+bool httb::hedge_tracker::applicable(const httb::request& request) const {
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (!m_enabled) {
+            return false;
+        }
+    }
+    return request.is_idempotent();
+}
+
+void httb::hedge_tracker::configure(bool enabled, double budget) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_enabled = enabled;
+    m_budget = std::max(0.0, budget);
+}
+
+void httb::hedge_tracker::set_delay(std::chrono::milliseconds delay) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_delay = delay;
+}
+
+void httb::hedge_tracker::set_percentile(double percentile) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_percentile = std::min(1.0, std::max(0.0, percentile));
+    for (auto& host : m_hosts) {
+        host.second.dirty = true;
+    }
+}
+
+httb::hedge_tracker::clock_t::duration httb::hedge_tracker::on_request(const std::string& key) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_stats.requests++;
+    m_tokens = std::min(MAX_TOKENS, m_tokens + m_budget);
+
+    if (m_delay.count() > 0) {
+        return m_delay;
+    }
+
+    auto it = m_hosts.find(key);
+    if (it == m_hosts.end() || it->second.latencies.size() < MIN_SAMPLES) {
+        return clock_t::duration::zero();
+    }
+
+    host_samples& host = it->second;
+    if (host.dirty) {
+        std::vector<int64_t> sorted = host.latencies;
+        const size_t idx = std::min(sorted.size() - 1, static_cast<size_t>(m_percentile * sorted.size()));
+        std::nth_element(sorted.begin(), sorted.begin() + idx, sorted.end());
+        host.percentile = sorted[idx];
+        host.dirty = false;
+    }
+    return std::chrono::microseconds(std::max<int64_t>(1, host.percentile));
+}
+
+bool httb::hedge_tracker::try_hedge() {
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (m_tokens < 1) {
+        m_stats.budget_exhausted++;
+        return false;
+    }
+    m_tokens -= 1;
+    m_stats.hedged++;
+    return true;
+}
+
+void httb::hedge_tracker::on_response(const std::string& key, clock_t::duration latency, bool hedge_won) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (hedge_won) {
+        m_stats.hedge_wins++;
+    }
+
+    host_samples& host = m_hosts[key];
+    const int64_t value = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+    if (host.latencies.size() < SAMPLES_WINDOW) {
+        host.latencies.push_back(value);
+    } else {
+        host.latencies[host.next] = value;
+        host.next = (host.next + 1) % SAMPLES_WINDOW;
+    }
+    host.dirty = true;
+}
+
+httb::hedge_stats httb::hedge_tracker::stats() const {
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_stats;
+}
@@ -0,0 +1,90 @@
+/*!
+ * httb.
+ * hedge_tracker.h
+ *
+ * \date 2019
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+#ifndef HTTB_HEDGE_TRACKER_H
+#define HTTB_HEDGE_TRACKER_H
+
+#include "httb/client.h"
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace httb {
+
+/// \brief Thread-safe state of hedged requests: delay before hedge, hedge budget and counters.
+/// Delay is either fixed or percentile of recent per-host latencies (last SAMPLES_WINDOW responses).
+/// Budget is token bucket: each request deposits `budget` tokens, each hedge takes one, so hedges
+/// can't exceed given share of requests, even when whole upstream is slow.
+class hedge_tracker {
+public:
+    using clock_t = std::chrono::steady_clock;
+
+    /// \brief How many latency samples per host are used for percentile
+    static const size_t SAMPLES_WINDOW = 128;
+    /// \brief Host latency percentile is not trusted until it has this number of samples
+    static const size_t MIN_SAMPLES = 20;
+
+    hedge_tracker();
+    virtual ~hedge_tracker();
+
+    /// \brief Whether request can be hedged: hedging enabled and method is idempotent
+    bool applicable(const httb::request& request) const;
+
+    /// \brief Set hedging settings, counters and samples are kept
+    /// \param enabled
+    /// \param budget max share of hedged requests
+    void configure(bool enabled, double budget);
+
+    /// \brief
+    /// \param delay fixed delay, zero - use latency percentile
+    void set_delay(std::chrono::milliseconds delay);
+    void set_percentile(double percentile);
+
+    /// \brief Count new request and calculate its hedge delay
+    /// \param key host:port
+    /// \return delay, or zero if request must not be hedged (host latency unknown yet)
+    clock_t::duration on_request(const std::string& key);
+
+    /// \brief Take token from budget to send hedge
+    /// \return false if budget exhausted
+    bool try_hedge();
+
+    /// \brief Record latency of successful response
+    void on_response(const std::string& key, clock_t::duration latency, bool hedge_won);
+
+    httb::hedge_stats stats() const;
+
+private:
+    /// \brief Budget bucket capacity: how many hedges can be sent in burst
+    static const double MAX_TOKENS;
+
+    struct host_samples {
+        std::vector<int64_t> latencies;
+        size_t next = 0;
+        /// \brief cached percentile, recalculated on new sample
+        int64_t percentile = 0;
+        bool dirty = false;
+    };
+
+    mutable std::mutex m_lock;
+    bool m_enabled = false;
+    double m_budget = 0.05;
+    double m_tokens = 0;
+    std::chrono::milliseconds m_delay{0};
+    double m_percentile = 0.95;
+    std::unordered_map<std::string, host_samples> m_hosts;
+    httb::hedge_stats m_stats;
+};
+
+} // namespace httb
+
+#endif //HTTB_HEDGE_TRACKER_H
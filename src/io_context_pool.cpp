@@ -0,0 +1,71 @@
+/*!
+ * httb.
+ * io_context_pool.cpp
+ *
+ * \date 2019
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+#include "io_context_pool.h"
+
+httb::io_context_pool::io_context_pool(size_t size) {
+    if (size == 0) {
+        size = 1;
+    }
+
+    m_contexts.reserve(size);
+    for (size_t i = 0; i < size; i++) {
+        // each context is run by exactly one thread
+        m_contexts.push_back(std::make_unique<net::io_context>(1));
+    }
+}
+
+httb::io_context_pool::~io_context_pool() {
+    m_work.clear();
+    for (auto& ctx : m_contexts) {
+        ctx->stop();
+    }
+    join();
+}
+
+size_t httb::io_context_pool::size() const {
+    return m_contexts.size();
+}
+
+net::io_context& httb::io_context_pool::get(size_t idx) {
+    return *m_contexts[idx];
+}
+
+void httb::io_context_pool::start() {
+    if (!m_threads.empty()) {
+        return;
+    }
+
+    m_work.clear();
+    m_threads.reserve(m_contexts.size());
+    for (auto& ctx : m_contexts) {
+        // context could be already run and stopped
+        ctx->restart();
+        m_work.push_back(std::make_unique<work_guard_t>(ctx->get_executor()));
+        net::io_context* ioc = ctx.get();
+        m_threads.emplace_back([ioc]() {
+            ioc->run();
+        });
+    }
+}
+
+void httb::io_context_pool::stop_when_idle() {
+    for (auto& work : m_work) {
+        work->reset();
+    }
+}
+
+void httb::io_context_pool::join() {
+    for (auto& thread : m_threads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    m_threads.clear();
+}
@@ -0,0 +1,60 @@
+/*!
+ * httb.
+ * io_context_pool.h
+ *
+ * \date 2019
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+#ifndef HTTB_IO_CONTEXT_POOL_H
+#define HTTB_IO_CONTEXT_POOL_H
+
+#include "httb/client.h"
+
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace httb {
+
+/// \brief Fixed set of io_contexts, each one is run by own worker thread.
+/// Objects bound to one context are always served by the same thread, so they don't need strands or locks.
+class io_context_pool {
+public:
+    /// \brief
+    /// \param size number of contexts and threads, at least 1
+    explicit io_context_pool(size_t size);
+
+    /// \brief Stops contexts and joins threads
+    virtual ~io_context_pool();
+
+    size_t size() const;
+
+    /// \brief Get context by index
+    /// \param idx index in range [0, size())
+    /// \return context
+    net::io_context& get(size_t idx);
+
+    /// \brief Start worker threads. Contexts don't run out of work until stop_when_idle() called
+    void start();
+
+    /// \brief Allow contexts to finish when they have no more work
+    void stop_when_idle();
+
+    /// \brief Wait all worker threads finished
+    void join();
+
+private:
+    using work_guard_t = net::executor_work_guard<net::io_context::executor_type>;
+
+    std::vector<std::unique_ptr<net::io_context>> m_contexts;
+    std::vector<std::unique_ptr<work_guard_t>> m_work;
+    std::vector<std::thread> m_threads;
+};
+
+} // namespace httb
+
+#endif //HTTB_IO_CONTEXT_POOL_H
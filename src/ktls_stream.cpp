@@ -0,0 +1,147 @@
+/*!
+ * httb.
+ * ktls_stream.cpp
+ *
+ * \date 2019
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+#include "ktls_stream.h"
+
+#include <boost/asio/error.hpp>
+#include <boost/asio/ssl/error.hpp>
+#include <cerrno>
+#include <openssl/err.h>
+
+httb::ktls_stream::ktls_stream(const executor_type& ex, boost::asio::ssl::context& ctx)
+    : m_next(ex),
+      m_ssl(SSL_new(ctx.native_handle())),
+      m_wait(std::make_shared<wait_state>(ex)) {
+    if (!m_ssl) {
+        throw boost::system::system_error(
+            boost::system::error_code(static_cast<int>(ERR_get_error()), boost::asio::error::get_ssl_category()),
+            "SSL_new");
+    }
+    SSL_set_connect_state(m_ssl);
+    // same modes as asio ssl engine: retried write may pass same data from other address, write returns per record
+    SSL_set_mode(m_ssl, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+#ifdef SSL_OP_ENABLE_KTLS
+    SSL_set_options(m_ssl, SSL_OP_ENABLE_KTLS);
+#endif
+}
+
+httb::ktls_stream::~ktls_stream() {
+    SSL_free(m_ssl);
+}
+
+httb::ktls_status httb::ktls_stream::status() const {
+    httb::ktls_status out;
+#ifdef SSL_OP_ENABLE_KTLS
+    BIO* wbio = SSL_get_wbio(m_ssl);
+    BIO* rbio = SSL_get_rbio(m_ssl);
+    out.send = wbio && BIO_get_ktls_send(wbio);
+    out.receive = rbio && BIO_get_ktls_recv(rbio);
+#endif
+    return out;
+}
+
+void httb::ktls_stream::expires_after(std::chrono::steady_clock::duration timeout) {
+    m_expiry = std::chrono::steady_clock::now() + timeout;
+}
+
+void httb::ktls_stream::expires_never() {
+    m_expiry = std::chrono::steady_clock::time_point::max();
+}
+
+void httb::ktls_stream::handshake(boost::system::error_code& ec) {
+    sync_io(op_type::handshake, nullptr, 0, ec);
+}
+
+httb::ktls_stream::io_result httb::ktls_stream::perform(op_type type, void* data, size_t size) {
+    io_result result;
+    boost::asio::ip::tcp::socket& socket = m_next.socket();
+    if (!socket.is_open()) {
+        result.ec = boost::asio::error::bad_descriptor;
+        return result;
+    }
+    // bind on first use: socket is opened by connect, after stream has been created
+    if (SSL_get_fd(m_ssl) != socket.native_handle()) {
+        SSL_set_fd(m_ssl, socket.native_handle());
+    }
+    if (type != op_type::handshake && size == 0) {
+        return result;
+    }
+    socket.native_non_blocking(true, result.ec);
+    if (result.ec) {
+        return result;
+    }
+
+    ERR_clear_error();
+    errno = 0;
+    int ret = 0;
+    switch (type) {
+    case op_type::handshake:
+        ret = SSL_do_handshake(m_ssl);
+        break;
+    case op_type::read:
+        ret = SSL_read_ex(m_ssl, data, size, &result.bytes);
+        break;
+    case op_type::write:
+        ret = SSL_write_ex(m_ssl, data, size, &result.bytes);
+        break;
+    }
+    if (ret == 1) {
+        return result;
+    }
+
+    const int sysErrno = errno;
+    const int err = SSL_get_error(m_ssl, ret);
+    switch (err) {
+    case SSL_ERROR_WANT_READ:
+        result.would_block = true;
+        result.wait = boost::asio::socket_base::wait_read;
+        break;
+    case SSL_ERROR_WANT_WRITE:
+        result.would_block = true;
+        result.wait = boost::asio::socket_base::wait_write;
+        break;
+    case SSL_ERROR_ZERO_RETURN:
+        result.ec = boost::asio::error::eof;
+        break;
+    case SSL_ERROR_SYSCALL:
+        if (ERR_peek_error() != 0) {
+            result.ec = boost::system::error_code(static_cast<int>(ERR_get_error()), boost::asio::error::get_ssl_category());
+        } else if (sysErrno != 0) {
+            result.ec = boost::system::error_code(sysErrno, boost::system::system_category());
+        } else {
+            result.ec = boost::asio::ssl::error::stream_truncated;
+        }
+        break;
+    default: {
+        const unsigned long code = ERR_get_error();
+#ifdef SSL_R_UNEXPECTED_EOF_WHILE_READING
+        if (ERR_GET_REASON(code) == SSL_R_UNEXPECTED_EOF_WHILE_READING) {
+            result.ec = boost::asio::ssl::error::stream_truncated;
+            break;
+        }
+#endif
+        result.ec = boost::system::error_code(static_cast<int>(code), boost::asio::error::get_ssl_category());
+    } break;
+    }
+    return result;
+}
+
+size_t httb::ktls_stream::sync_io(op_type type, void* data, size_t size, boost::system::error_code& ec) {
+    while (true) {
+        io_result result = perform(type, data, size);
+        if (!result.would_block) {
+            ec = result.ec;
+            return result.bytes;
+        }
+        m_next.socket().wait(result.wait, ec);
+        if (ec) {
+            return 0;
+        }
+    }
+}
@@ -0,0 +1,276 @@
+/*!
+ * httb.
+ * ktls_stream.h
+ *
+ * \date 2019
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+#ifndef HTTB_KTLS_STREAM_H
+#define HTTB_KTLS_STREAM_H
+
+#include "httb/types.h"
+
+#include <boost/asio/associated_executor.hpp>
+#include <boost/asio/bind_executor.hpp>
+#include <boost/asio/compose.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/ssl/context.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/beast/core/tcp_stream.hpp>
+#include <boost/system/error_code.hpp>
+#include <boost/system/system_error.hpp>
+#include <chrono>
+#include <memory>
+#include <openssl/ssl.h>
+#include <vector>
+
+namespace httb {
+
+/// \brief TLS stream which can pass record encryption and decryption to kernel (Linux kTLS). Unlike asio ssl::stream,
+/// which feeds OpenSSL through memory BIO, OpenSSL works right on socket here, so with SSL_OP_ENABLE_KTLS it configures
+/// kernel after handshake. If kernel, OpenSSL build or negotiated cipher doesn't support offload, OpenSSL encrypts
+/// in user space as usual: stream works anyway, status() tells what has been offloaded.
+/// Satisfies beast sync and async stream requirements
+class ktls_stream {
+public:
+    using next_layer_type = boost::beast::tcp_stream;
+    using executor_type = next_layer_type::executor_type;
+
+    ktls_stream(const executor_type& ex, boost::asio::ssl::context& ctx);
+    ktls_stream(const ktls_stream&) = delete;
+    ktls_stream& operator=(const ktls_stream&) = delete;
+    ~ktls_stream();
+
+    executor_type get_executor() noexcept {
+        return m_next.get_executor();
+    }
+    next_layer_type& next_layer() {
+        return m_next;
+    }
+    SSL* native_handle() {
+        return m_ssl;
+    }
+
+    /// \brief Which directions are offloaded to kernel, valid after handshake
+    httb::ktls_status status() const;
+
+    /// \brief Timeout of async operations, like beast::tcp_stream has. Expired operation completes with
+    /// beast::error::timeout and socket is closed
+    void expires_after(std::chrono::steady_clock::duration timeout);
+    void expires_never();
+
+    void handshake(boost::system::error_code& ec);
+
+    template<typename Handler>
+    auto async_handshake(Handler&& handler) {
+        return async_io<void(boost::system::error_code)>(op_type::handshake, nullptr, 0, std::forward<Handler>(handler));
+    }
+
+    template<typename MutableBufferSequence>
+    size_t read_some(const MutableBufferSequence& buffers, boost::system::error_code& ec) {
+        const boost::asio::mutable_buffer buffer = first_buffer(buffers);
+        return sync_io(op_type::read, buffer.data(), buffer.size(), ec);
+    }
+
+    template<typename MutableBufferSequence>
+    size_t read_some(const MutableBufferSequence& buffers) {
+        boost::system::error_code ec;
+        const size_t bytes = read_some(buffers, ec);
+        if (ec) {
+            throw boost::system::system_error(ec);
+        }
+        return bytes;
+    }
+
+    template<typename ConstBufferSequence>
+    size_t write_some(const ConstBufferSequence& buffers, boost::system::error_code& ec) {
+        const boost::asio::const_buffer buffer = prepare_write(buffers);
+        return sync_io(op_type::write, const_cast<void*>(buffer.data()), buffer.size(), ec);
+    }
+
+    template<typename ConstBufferSequence>
+    size_t write_some(const ConstBufferSequence& buffers) {
+        boost::system::error_code ec;
+        const size_t bytes = write_some(buffers, ec);
+        if (ec) {
+            throw boost::system::system_error(ec);
+        }
+        return bytes;
+    }
+
+    template<typename MutableBufferSequence, typename Handler>
+    auto async_read_some(const MutableBufferSequence& buffers, Handler&& handler) {
+        const boost::asio::mutable_buffer buffer = first_buffer(buffers);
+        return async_io<void(boost::system::error_code, size_t)>(op_type::read, buffer.data(), buffer.size(), std::forward<Handler>(handler));
+    }
+
+    template<typename ConstBufferSequence, typename Handler>
+    auto async_write_some(const ConstBufferSequence& buffers, Handler&& handler) {
+        const boost::asio::const_buffer buffer = prepare_write(buffers);
+        return async_io<void(boost::system::error_code, size_t)>(op_type::write, const_cast<void*>(buffer.data()), buffer.size(),
+                                                                  std::forward<Handler>(handler));
+    }
+
+private:
+    enum class op_type {
+        handshake,
+        read,
+        write,
+    };
+
+    /// \brief Result of single OpenSSL call
+    struct io_result {
+        size_t bytes = 0;
+        boost::system::error_code ec;
+        /// \brief socket is not ready, wait for it and repeat
+        bool would_block = false;
+        boost::asio::socket_base::wait_type wait = boost::asio::socket_base::wait_read;
+    };
+
+    /// \brief Shared with pending handlers, which may outlive stream
+    struct wait_state {
+        explicit wait_state(const executor_type& ex)
+            : timer(ex) {
+        }
+        boost::asio::steady_timer timer;
+        boost::asio::ip::tcp::socket* socket = nullptr;
+        bool timed_out = false;
+    };
+
+    /// \brief Composed operation: repeats OpenSSL call until it's done, waiting for socket readiness
+    template<typename Signature>
+    struct io_op {
+        ktls_stream& stream;
+        op_type type;
+        void* data;
+        size_t size;
+
+        template<typename Self>
+        void operator()(Self& self) {
+            run(self, false);
+        }
+
+        template<typename Self>
+        void operator()(Self& self, boost::system::error_code ec) {
+            if (ec) {
+                complete(self, ec, 0);
+                return;
+            }
+            run(self, true);
+        }
+
+        template<typename Self>
+        void run(Self& self, bool cont) {
+            const io_result result = stream.perform(type, data, size);
+            if (result.would_block) {
+                stream.wait(result.wait, std::move(self));
+                return;
+            }
+            if (!cont) {
+                // never call handler from initiating function
+                const auto ex = boost::asio::get_associated_executor(self, stream.get_executor());
+                boost::asio::post(ex, [self = std::move(self), result]() mutable {
+                    complete(self, result.ec, result.bytes);
+                });
+                return;
+            }
+            complete(self, result.ec, result.bytes);
+        }
+
+        template<typename Self>
+        static void complete(Self& self, boost::system::error_code ec, size_t bytes) {
+            if constexpr (std::is_same<Signature, void(boost::system::error_code)>::value) {
+                (void) bytes;
+                self.complete(ec);
+            } else {
+                self.complete(ec, bytes);
+            }
+        }
+    };
+
+    /// \brief Small buffers of write are coalesced, to avoid TLS record for each of them
+    static const size_t MAX_COALESCE_SIZE = 16 * 1024;
+
+    next_layer_type m_next;
+    SSL* m_ssl;
+    std::shared_ptr<wait_state> m_wait;
+    std::chrono::steady_clock::time_point m_expiry = std::chrono::steady_clock::time_point::max();
+    std::vector<char> m_coalesce;
+
+    io_result perform(op_type type, void* data, size_t size);
+    size_t sync_io(op_type type, void* data, size_t size, boost::system::error_code& ec);
+
+    template<typename Signature, typename Handler>
+    auto async_io(op_type type, void* data, size_t size, Handler&& handler) {
+        return boost::asio::async_compose<Handler, Signature>(io_op<Signature>{*this, type, data, size}, handler, m_next);
+    }
+
+    /// \brief Wait for socket readiness. Handlers run on executor of operation (caller's strand),
+    /// so ssl state and socket are not touched concurrently with other operations of caller
+    template<typename Self>
+    void wait(boost::asio::socket_base::wait_type type, Self&& self) {
+        const auto ex = boost::asio::get_associated_executor(self, get_executor());
+        m_wait->socket = &m_next.socket();
+        if (m_expiry != std::chrono::steady_clock::time_point::max()) {
+            m_wait->timer.expires_at(m_expiry);
+            std::weak_ptr<wait_state> weak = m_wait;
+            m_wait->timer.async_wait(boost::asio::bind_executor(ex, [weak](boost::system::error_code ec) {
+                auto state = weak.lock();
+                if (ec || !state) {
+                    return;
+                }
+                state->timed_out = true;
+                boost::system::error_code ignored;
+                state->socket->close(ignored);
+            }));
+        }
+
+        std::weak_ptr<wait_state> weak = m_wait;
+        m_next.socket().async_wait(type, boost::asio::bind_executor(ex, [weak, self = std::forward<Self>(self)](boost::system::error_code ec) mutable {
+            if (auto state = weak.lock()) {
+                state->timer.cancel();
+                if (state->timed_out) {
+                    state->timed_out = false;
+                    ec = boost::beast::error::timeout;
+                }
+            }
+            self(ec);
+        }));
+    }
+
+    template<typename MutableBufferSequence>
+    static boost::asio::mutable_buffer first_buffer(const MutableBufferSequence& buffers) {
+        for (auto it = boost::asio::buffer_sequence_begin(buffers); it != boost::asio::buffer_sequence_end(buffers); ++it) {
+            const boost::asio::mutable_buffer buffer(*it);
+            if (buffer.size() > 0) {
+                return buffer;
+            }
+        }
+        return {};
+    }
+
+    template<typename ConstBufferSequence>
+    boost::asio::const_buffer prepare_write(const ConstBufferSequence& buffers) {
+        boost::asio::const_buffer first;
+        for (auto it = boost::asio::buffer_sequence_begin(buffers); it != boost::asio::buffer_sequence_end(buffers); ++it) {
+            first = boost::asio::const_buffer(*it);
+            if (first.size() > 0) {
+                break;
+            }
+        }
+        const size_t total = boost::asio::buffer_size(buffers);
+        if (first.size() == total || first.size() >= MAX_COALESCE_SIZE) {
+            return first;
+        }
+        m_coalesce.resize(total < MAX_COALESCE_SIZE ? total : MAX_COALESCE_SIZE);
+        const size_t copied = boost::asio::buffer_copy(boost::asio::buffer(m_coalesce), buffers);
+        return boost::asio::const_buffer(m_coalesce.data(), copied);
+    }
+};
+
+} // namespace httb
+
+#endif //HTTB_KTLS_STREAM_H
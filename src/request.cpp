@@ -228,6 +228,20 @@ std::string httb::base_request::get_method_str() const {
     return method_to_string(get_method());
 }
 
+bool httb::base_request::is_idempotent() const {
+    switch (get_method()) {
+        case method::get:
+        case method::head:
+        case method::options:
+        case method::trace:
+        case method::put:
+        case method::delete_:
+            return true;
+        default:
+            return false;
+    }
+}
+
 bool httb::base_request::has_query() const {
     return !m_params.empty();
 }
@@ -496,20 +510,32 @@ void httb::base_request::add_path(const std::string& path) {
     }
 }
 
+void httb::base_request::set_deadline(std::chrono::steady_clock::duration deadline) {
+    m_deadline = deadline;
+}
+
+std::chrono::steady_clock::duration httb::base_request::get_deadline() const {
+    return m_deadline;
+}
+
 bool httb::base_request::is_ssl() const {
     return m_ssl;
 }
 
-boost::beast::http::request<boost::beast::http::string_body> httb::request::to_beast_request() const {
+boost::beast::http::request<httb::request_body_type> httb::request::to_beast_request() const {
     namespace http = boost::beast::http;
 
-    http::request<http::string_body> req{get_method(), get_path_with_query(), 11};
+    http::request<httb::request_body_type> req{get_method(), get_path_with_query(), 11};
     req.set(http::field::host, get_host());
 
-    std::stringstream versionBuilder;
-    versionBuilder << "httb/" << HTTB_VERSION;
-    versionBuilder << " (boost " << BOOST_VERSION << ")";
-    req.set(http::field::user_agent, versionBuilder.str());
+    // built once: stream formatting is expensive for every request
+    static const std::string userAgent = []() {
+        std::stringstream versionBuilder;
+        versionBuilder << "httb/" << HTTB_VERSION;
+        versionBuilder << " (boost " << BOOST_VERSION << ")";
+        return versionBuilder.str();
+    }();
+    req.set(http::field::user_agent, userAgent);
     req.set(http::field::accept, "*/*");
     req.set(http::field::content_length, "0");
 
@@ -517,23 +543,61 @@ boost::beast::http::request<boost::beast::http::string_body> httb::request::to_b
         req.set(field.first, field.second);
     }
 
-    if (has_body()) {
-        req.body() = get_body();
+    if (m_body_source) {
+        req.body().source = m_body_source;
+        if (m_body_source->size()) {
+            req.prepare_payload();
+        } else {
+            req.chunked(true);
+        }
+    } else if (has_body()) {
+        req.body().data = get_body();
         req.prepare_payload();
     }
 
     return req;
 }
 void httb::request::set_body(const std::string& body) {
+    m_body_source.reset();
     io_container::set_body(body);
 }
 void httb::request::set_body(std::string&& body) {
+    m_body_source.reset();
     io_container::set_body(body);
 }
 void httb::request::set_body(const httb::request_body& body) {
-    io_container::set_body(body.build(this));
+    auto source = body.build_source(this);
+    if (source) {
+        set_body_source(std::move(source));
+        return;
+    }
+    set_body(body.build(this));
 }
 void httb::request::set_body(httb::request_body&& body) {
+    auto source = body.build_source(this);
+    if (source) {
+        set_body_source(std::move(source));
+        return;
+    }
     std::string builtBody = body.build(this);
-    io_container::set_body(std::move(builtBody));
+    set_body(std::move(builtBody));
+}
+void httb::request::set_body_source(std::shared_ptr<const httb::body_source> source) {
+    io_container::clear_body();
+    m_body_source = std::move(source);
+    if (m_body_source && m_body_source->size()) {
+        set_header({"Content-Length", httb::to_string(*m_body_source->size())});
+    } else {
+        remove_header("Content-Length");
+    }
+}
+std::shared_ptr<const httb::body_source> httb::request::get_body_source() const {
+    return m_body_source;
+}
+bool httb::request::has_body() const {
+    return m_body_source != nullptr || io_container::has_body();
+}
+void httb::request::clear_body() {
+    m_body_source.reset();
+    io_container::clear_body();
 }
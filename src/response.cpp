@@ -14,6 +14,10 @@
 #include <iostream>
 #include <toolbox/strings.hpp>
 
+const int httb::response::INTERNAL_ERROR_OFFSET;
+const int httb::response::CIRCUIT_OPEN;
+const int httb::response::DEADLINE_EXCEEDED;
+
 httb::response::response()
     : code(200), status(http_status::ok), status_message("Ok") {
 }
@@ -0,0 +1,177 @@
+/*!
+ * httb.
+ * retry_tracker.cpp
+ *
+ * \date 2019
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+#include "retry_tracker.h"
+
+#include <algorithm>
+#include <boost/asio/error.hpp>
+#include <boost/beast/core/error.hpp>
+#include <cctype>
+#include <ctime>
+#include <iomanip>
+#include <sstream>
+
+httb::retry_tracker::retry_tracker()
+    : m_rng(std::random_device{}()) {
+}
+
+httb::retry_tracker::~retry_tracker() {
+}
+
+bool httb::retry_tracker::is_retryable(const httb::request& request, boost::system::error_code ec) {
+    if (ec == boost::asio::error::connection_refused) {
+        return true;
+    }
+    if (!request.is_idempotent()) {
+        return false;
+    }
+    return ec == boost::asio::error::connection_reset ||
+           ec == boost::asio::error::connection_aborted ||
+           ec == boost::asio::error::broken_pipe ||
+           ec == boost::asio::error::timed_out ||
+           ec == boost::asio::error::host_unreachable ||
+           ec == boost::asio::error::network_unreachable ||
+           ec == boost::beast::error::timeout;
+}
+
+bool httb::retry_tracker::is_retryable(const httb::request& request, const httb::response& response) {
+    const int code = response.code;
+    if (code >= httb::response::INTERNAL_ERROR_OFFSET) {
+        // response keeps only error value, category is known where error happened
+        return response.retryable;
+    }
+
+    if (!request.is_idempotent()) {
+        return false;
+    }
+    return code == 429 || code == 502 || code == 503 || code == 504;
+}
+
+bool httb::retry_tracker::parse_retry_after(const std::string& value, std::chrono::milliseconds& out) {
+    if (value.empty()) {
+        return false;
+    }
+
+    if (std::all_of(value.begin(), value.end(), ::isdigit)) {
+        out = std::chrono::seconds(std::stoll(value.substr(0, 9)));
+        return true;
+    }
+
+    // IMF-fixdate: Sun, 06 Nov 1994 08:49:37 GMT
+    std::tm tm = {};
+    std::istringstream ss(value);
+    ss.imbue(std::locale::classic());
+    ss >> std::get_time(&tm, "%a, %d %b %Y %H:%M:%S");
+    if (ss.fail()) {
+        return false;
+    }
+#ifdef _WIN32
+    const auto at = std::chrono::system_clock::from_time_t(_mkgmtime(&tm));
+#else
+    const auto at = std::chrono::system_clock::from_time_t(timegm(&tm));
+#endif
+    const auto now = std::chrono::system_clock::now();
+    out = at > now ? std::chrono::duration_cast<std::chrono::milliseconds>(at - now) : std::chrono::milliseconds(0);
+    return true;
+}
+
+void httb::retry_tracker::configure(size_t max_retries, std::chrono::milliseconds base_delay, std::chrono::milliseconds max_delay) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_max_retries = max_retries;
+    m_base_delay = std::max(std::chrono::milliseconds(1), base_delay);
+    m_max_delay = std::max(m_base_delay, max_delay);
+}
+
+void httb::retry_tracker::set_budget(double ratio, size_t burst) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_ratio = std::max(0.0, ratio);
+    m_burst = static_cast<double>(burst);
+    m_hosts.clear();
+}
+
+void httb::retry_tracker::set_retry_after(bool honor) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_retry_after = honor;
+}
+
+bool httb::retry_tracker::enabled() const {
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_max_retries > 0;
+}
+
+void httb::retry_tracker::on_request(const std::string& key) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    host_budget& budget = get_budget(key);
+    budget.tokens = std::min(m_burst, budget.tokens + m_ratio);
+}
+
+bool httb::retry_tracker::next(const std::string& key, const httb::request& request, const httb::response& response, size_t attempt,
+                               std::chrono::milliseconds& delay,
+                               std::chrono::steady_clock::time_point deadline) {
+    if (!is_retryable(request, response)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (attempt >= m_max_retries) {
+        m_stats.exhausted++;
+        return false;
+    }
+
+    std::chrono::milliseconds retryAfter(0);
+    const bool hasRetryAfter = m_retry_after && response.has_header("retry-after") &&
+                               parse_retry_after(response.get_header_value("retry-after"), retryAfter);
+    if (hasRetryAfter && retryAfter > m_max_delay) {
+        // server asks to come back later than we can wait
+        m_stats.exhausted++;
+        return false;
+    }
+
+    // decorrelated jitter: random between base and 3x previous delay, capped.
+    // First retry counts from base too, otherwise clients failed at same moment retry at same moment
+    const int64_t base = m_base_delay.count();
+    const int64_t prev = delay.count() > 0 ? delay.count() : base;
+    const int64_t upper = std::max(base, std::min(m_max_delay.count(), prev * 3));
+    std::uniform_int_distribution<int64_t> dist(base, upper);
+    std::chrono::milliseconds nextDelay(dist(m_rng));
+    if (hasRetryAfter) {
+        nextDelay = std::max(nextDelay, retryAfter);
+    }
+    // retry that would start after deadline is useless: last response is more informative than timeout
+    if (deadline - std::chrono::steady_clock::now() <= nextDelay) {
+        m_stats.exhausted++;
+        return false;
+    }
+
+    host_budget& budget = get_budget(key);
+    if (budget.tokens < 1) {
+        m_stats.budget_exhausted++;
+        return false;
+    }
+    budget.tokens -= 1;
+
+    delay = nextDelay;
+    m_stats.retries++;
+    return true;
+}
+
+httb::retry_stats httb::retry_tracker::stats() const {
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_stats;
+}
+
+httb::retry_tracker::host_budget& httb::retry_tracker::get_budget(const std::string& key) {
+    auto it = m_hosts.find(key);
+    if (it == m_hosts.end()) {
+        // full bucket for new host: first failures are retried right away
+        it = m_hosts.emplace(key, host_budget()).first;
+        it->second.tokens = m_burst;
+    }
+    return it->second;
+}
@@ -0,0 +1,96 @@
+/*!
+ * httb.
+ * retry_tracker.h
+ *
+ * \date 2019
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+#ifndef HTTB_RETRY_TRACKER_H
+#define HTTB_RETRY_TRACKER_H
+
+#include "httb/client.h"
+
+#include <boost/system/error_code.hpp>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <string>
+#include <unordered_map>
+
+namespace httb {
+
+/// \brief Thread-safe retry policy: classification of retryable failures, backoff with decorrelated jitter,
+/// Retry-After and per-host retry budget.
+/// Budget is token bucket: each request deposits `ratio` tokens, each retry takes one, bucket holds at most `burst` tokens.
+/// So when host fails completely, retries add at most `ratio` share of load instead of multiplying it.
+class retry_tracker {
+public:
+    retry_tracker();
+    virtual ~retry_tracker();
+
+    /// \brief Whether transport error of request may be repeated. Idempotent requests are retried on connection
+    /// errors and timeouts, others only if connection was refused (request has not been sent).
+    /// Error is compared with its category: values of different categories overlap
+    static bool is_retryable(const httb::request& request, boost::system::error_code ec);
+
+    /// \brief Whether failed request may be repeated: transport error marked as response::retryable,
+    /// or 429, 502, 503, 504 response of idempotent request
+    static bool is_retryable(const httb::request& request, const httb::response& response);
+
+    /// \brief Parse Retry-After value: delay in seconds or HTTP-date
+    /// \param value header value
+    /// \param out delay from now
+    /// \return false if value can't be parsed
+    static bool parse_retry_after(const std::string& value, std::chrono::milliseconds& out);
+
+    /// \brief
+    /// \param max_retries 0 disables retries
+    /// \param base_delay
+    /// \param max_delay
+    void configure(size_t max_retries, std::chrono::milliseconds base_delay, std::chrono::milliseconds max_delay);
+    void set_budget(double ratio, size_t burst);
+    void set_retry_after(bool honor);
+    bool enabled() const;
+
+    /// \brief Count new request (not retry) of host, deposits budget tokens
+    /// \param key host:port
+    void on_request(const std::string& key);
+
+    /// \brief Decide whether to retry failed attempt and calculate delay
+    /// \param key host:port
+    /// \param request
+    /// \param response response of attempt
+    /// \param attempt number of retries already made
+    /// \param delay in: previous delay (zero before first retry), out: delay before next attempt
+    /// \param deadline retry that would start after it is not made and doesn't take budget
+    /// \return true if request should be retried after delay
+    bool next(const std::string& key, const httb::request& request, const httb::response& response, size_t attempt,
+              std::chrono::milliseconds& delay,
+              std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max());
+
+    httb::retry_stats stats() const;
+
+private:
+    struct host_budget {
+        double tokens = 0;
+    };
+
+    mutable std::mutex m_lock;
+    size_t m_max_retries = 0;
+    std::chrono::milliseconds m_base_delay{100};
+    std::chrono::milliseconds m_max_delay{10000};
+    double m_ratio = 0.1;
+    double m_burst = 10;
+    bool m_retry_after = true;
+    std::mt19937 m_rng;
+    std::unordered_map<std::string, host_budget> m_hosts;
+    httb::retry_stats m_stats;
+
+    host_budget& get_budget(const std::string& key);
+};
+
+} // namespace httb
+
+#endif //HTTB_RETRY_TRACKER_H
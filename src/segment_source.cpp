@@ -0,0 +1,134 @@
+/*!
+ * httb.
+ * segment_source.cpp
+ *
+ * \date 2019
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+#include "segment_source.h"
+
+#include <algorithm>
+#include <boost/asio/error.hpp>
+#include <boost/beast/core/file.hpp>
+#include <boost/system/system_error.hpp>
+
+const size_t httb::segment_source::FILE_CHUNK_SIZE;
+
+namespace {
+
+class segment_reader : public httb::body_source_reader {
+public:
+    explicit segment_reader(std::shared_ptr<const std::vector<httb::body_segment>> segments)
+        : m_segments(std::move(segments)) {
+    }
+
+    boost::asio::const_buffer next(boost::system::error_code& ec) override {
+        while (m_idx < m_segments->size()) {
+            const httb::body_segment& segment = (*m_segments)[m_idx];
+            if (segment.path.empty()) {
+                m_idx++;
+                if (segment.data.empty()) {
+                    continue;
+                }
+                return boost::asio::const_buffer(segment.data.data(), segment.data.size());
+            }
+
+            if (!m_file.is_open()) {
+                m_file.open(segment.path.c_str(), boost::beast::file_mode::scan, ec);
+                if (!ec && segment.offset > 0) {
+                    m_file.seek(segment.offset, ec);
+                }
+                if (ec) {
+                    return {};
+                }
+                m_remaining = segment.size;
+            }
+            if (m_remaining == 0) {
+                m_file.close(ec);
+                m_idx++;
+                continue;
+            }
+
+            if (!m_chunk) {
+                m_chunk = std::make_unique<char[]>(httb::segment_source::FILE_CHUNK_SIZE);
+            }
+            const size_t read = m_file.read(m_chunk.get(), std::min<uint64_t>(httb::segment_source::FILE_CHUNK_SIZE, m_remaining), ec);
+            if (ec) {
+                return {};
+            }
+            if (read == 0) {
+                // file has been truncated after Content-Length was calculated
+                ec = boost::asio::error::eof;
+                return {};
+            }
+            m_remaining -= read;
+            return boost::asio::const_buffer(m_chunk.get(), read);
+        }
+        return {};
+    }
+
+private:
+    std::shared_ptr<const std::vector<httb::body_segment>> m_segments;
+    size_t m_idx = 0;
+    boost::beast::file m_file;
+    uint64_t m_remaining = 0;
+    std::unique_ptr<char[]> m_chunk;
+};
+
+} // namespace
+
+httb::segment_source::segment_source(std::vector<httb::body_segment>&& segments)
+    : m_segments(std::make_shared<std::vector<httb::body_segment>>(std::move(segments))) {
+    for (const auto& segment : *m_segments) {
+        m_size += segment.path.empty() ? segment.data.size() : segment.size;
+    }
+}
+
+httb::body_segment httb::segment_source::file_segment(const std::string& path) {
+    boost::system::error_code ec;
+    boost::beast::file file;
+    file.open(path.c_str(), boost::beast::file_mode::read, ec);
+    const uint64_t size = ec ? 0 : file.size(ec);
+    if (ec) {
+        throw boost::system::system_error(ec, path);
+    }
+
+    httb::body_segment segment;
+    segment.path = path;
+    segment.size = size;
+    return segment;
+}
+
+std::string httb::segment_source::read_all(const httb::body_source& source) {
+    std::string out;
+    out.reserve(static_cast<size_t>(source.size().value_or(0)));
+
+    boost::system::error_code ec;
+    auto reader = source.open(ec);
+    while (!ec) {
+        const boost::asio::const_buffer piece = reader->next(ec);
+        if (piece.size() == 0) {
+            break;
+        }
+        out.append(static_cast<const char*>(piece.data()), piece.size());
+    }
+    if (ec) {
+        throw boost::system::system_error(ec);
+    }
+    return out;
+}
+
+boost::optional<uint64_t> httb::segment_source::size() const {
+    return m_size;
+}
+
+std::unique_ptr<httb::body_source_reader> httb::segment_source::open(boost::system::error_code& ec) const {
+    ec = {};
+    return std::make_unique<segment_reader>(m_segments);
+}
+
+const std::vector<httb::body_segment>* httb::segment_source::segments() const {
+    return m_segments.get();
+}
@@ -0,0 +1,49 @@
+/*!
+ * httb.
+ * segment_source.h
+ *
+ * \date 2019
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+#ifndef HTTB_SEGMENT_SOURCE_H
+#define HTTB_SEGMENT_SOURCE_H
+
+#include "httb/body_source.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace httb {
+
+/// \brief Body made of in-memory and file segments. Files are read by chunks while request is being written,
+/// or sent by zero_copy_writer over plain connection
+class segment_source : public httb::body_source {
+public:
+    /// \brief Size of file chunk read while writing request
+    static const size_t FILE_CHUNK_SIZE = 64 * 1024;
+
+    explicit segment_source(std::vector<httb::body_segment>&& segments);
+
+    /// \brief Make segment of whole file
+    /// \throws boost::system::system_error if file can't be opened
+    static httb::body_segment file_segment(const std::string& path);
+
+    /// \brief Read whole body into memory
+    /// \throws boost::system::system_error on read error
+    static std::string read_all(const httb::body_source& source);
+
+    boost::optional<uint64_t> size() const override;
+    std::unique_ptr<httb::body_source_reader> open(boost::system::error_code& ec) const override;
+    const std::vector<httb::body_segment>* segments() const override;
+
+private:
+    std::shared_ptr<const std::vector<httb::body_segment>> m_segments;
+    uint64_t m_size = 0;
+};
+
+} // namespace httb
+
+#endif //HTTB_SEGMENT_SOURCE_H
@@ -0,0 +1,151 @@
+/*!
+ * httb.
+ * tls_session_cache.cpp
+ *
+ * \date 2019
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+#include "tls_session_cache.h"
+
+#include <ctime>
+
+static int ssl_key_index() {
+    static const int idx = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+    return idx;
+}
+
+static int ssl_ctx_cache_index() {
+    static const int idx = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+    return idx;
+}
+
+static bool is_resumable(SSL_SESSION* session) {
+    if (!SSL_SESSION_is_resumable(session)) {
+        return false;
+    }
+    const long expires = SSL_SESSION_get_time(session) + SSL_SESSION_get_timeout(session);
+    return expires > static_cast<long>(std::time(nullptr));
+}
+
+httb::tls_session_cache::tls_session_cache(std::shared_ptr<boost::asio::ssl::context> ctx, size_t max_sessions)
+    : m_ctx(std::move(ctx)),
+      m_max_sessions(max_sessions) {
+    SSL_CTX* native = m_ctx->native_handle();
+    // client mode, we store sessions by ourselves: openssl internal cache is keyed by session id, not by host
+    SSL_CTX_set_session_cache_mode(native, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_set_ex_data(native, ssl_ctx_cache_index(), this);
+    SSL_CTX_sess_set_new_cb(native, &tls_session_cache::on_new_session);
+}
+
+httb::tls_session_cache::~tls_session_cache() {
+    // context may outlive cache inside pooled connections
+    SSL_CTX_sess_set_new_cb(m_ctx->native_handle(), nullptr);
+    SSL_CTX_set_ex_data(m_ctx->native_handle(), ssl_ctx_cache_index(), nullptr);
+    clear();
+}
+
+std::shared_ptr<boost::asio::ssl::context> httb::tls_session_cache::context() const {
+    return m_ctx;
+}
+
+void httb::tls_session_cache::set_enabled(bool enabled) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_enabled = enabled;
+}
+
+bool httb::tls_session_cache::prepare(SSL* ssl, const std::string& key, const std::string& host) {
+    // Set SNI Hostname (many hosts need this to handshake successfully)
+    if (!SSL_set_tlsext_host_name(ssl, host.c_str())) {
+        return false;
+    }
+    SSL_set_ex_data(ssl, ssl_key_index(), const_cast<std::string*>(&key));
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (!m_enabled) {
+        return true;
+    }
+
+    auto it = m_sessions.find(key);
+    if (it == m_sessions.end()) {
+        return true;
+    }
+
+    if (!is_resumable(it->second)) {
+        SSL_SESSION_free(it->second);
+        m_sessions.erase(it);
+        m_stats.cached_sessions = m_sessions.size();
+        return true;
+    }
+
+    // ssl holds own reference
+    SSL_set_session(ssl, it->second);
+    return true;
+}
+
+void httb::tls_session_cache::on_handshake(SSL* ssl) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (SSL_session_reused(ssl)) {
+        m_stats.resumed_handshakes++;
+    } else {
+        m_stats.full_handshakes++;
+    }
+}
+
+void httb::tls_session_cache::on_ktls(const httb::ktls_status& status) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (status.send) {
+        m_stats.ktls_send++;
+    }
+    if (status.receive) {
+        m_stats.ktls_receive++;
+    }
+    if (!status.send && !status.receive) {
+        m_stats.ktls_fallbacks++;
+    }
+}
+
+httb::tls_stats httb::tls_session_cache::stats() const {
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_stats;
+}
+
+void httb::tls_session_cache::clear() {
+    std::lock_guard<std::mutex> lock(m_lock);
+    for (auto& entry : m_sessions) {
+        SSL_SESSION_free(entry.second);
+    }
+    m_sessions.clear();
+    m_stats.cached_sessions = 0;
+}
+
+int httb::tls_session_cache::on_new_session(SSL* ssl, SSL_SESSION* session) {
+    auto* cache = static_cast<tls_session_cache*>(SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), ssl_ctx_cache_index()));
+    auto* key = static_cast<const std::string*>(SSL_get_ex_data(ssl, ssl_key_index()));
+    if (!cache || !key) {
+        // openssl frees session by itself
+        return 0;
+    }
+
+    cache->store(*key, session);
+    // we took session reference
+    return 1;
+}
+
+void httb::tls_session_cache::store(const std::string& key, SSL_SESSION* session) {
+    std::lock_guard<std::mutex> lock(m_lock);
+    auto it = m_sessions.find(key);
+    if (it != m_sessions.end()) {
+        SSL_SESSION_free(it->second);
+        it->second = session;
+        return;
+    }
+
+    if (m_sessions.size() >= m_max_sessions && !m_sessions.empty()) {
+        SSL_SESSION_free(m_sessions.begin()->second);
+        m_sessions.erase(m_sessions.begin());
+    }
+    m_sessions.emplace(key, session);
+    m_stats.cached_sessions = m_sessions.size();
+}
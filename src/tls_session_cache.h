@@ -0,0 +1,74 @@
+/*!
+ * httb.
+ * tls_session_cache.h
+ *
+ * \date 2019
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+#ifndef HTTB_TLS_SESSION_CACHE_H
+#define HTTB_TLS_SESSION_CACHE_H
+
+#include "httb/client.h"
+
+#include <boost/asio/ssl/context.hpp>
+#include <memory>
+#include <mutex>
+#include <openssl/ssl.h>
+#include <string>
+#include <unordered_map>
+
+namespace httb {
+
+/// \brief Client-side TLS session cache, bound to shared ssl context.
+/// Sessions (ids or tickets, including TLS 1.3 post-handshake tickets) are stored by connection key (host and port)
+/// and offered on next handshake to the same host, so server can resume session instead of full handshake.
+class tls_session_cache {
+public:
+    /// \brief Install new-session callback into context
+    /// \param ctx shared ssl context
+    /// \param max_sessions how many hosts to remember
+    explicit tls_session_cache(std::shared_ptr<boost::asio::ssl::context> ctx, size_t max_sessions = 256);
+    virtual ~tls_session_cache();
+
+    std::shared_ptr<boost::asio::ssl::context> context() const;
+
+    /// \brief Enable or disable offering cached sessions. Counters still work
+    void set_enabled(bool enabled);
+
+    /// \brief Set SNI and offer cached session before handshake
+    /// \param ssl native handle
+    /// \param key connection key, must live as long as ssl handle
+    /// \param host server name
+    /// \return false if SNI can't be set
+    bool prepare(SSL* ssl, const std::string& key, const std::string& host);
+
+    /// \brief Count completed handshake as full or resumed
+    /// \param ssl native handle
+    void on_handshake(SSL* ssl);
+
+    /// \brief Count kernel TLS offload state of new ktls connection
+    /// \param status
+    void on_ktls(const httb::ktls_status& status);
+
+    httb::tls_stats stats() const;
+
+    /// \brief Drop all stored sessions
+    void clear();
+
+private:
+    static int on_new_session(SSL* ssl, SSL_SESSION* session);
+    void store(const std::string& key, SSL_SESSION* session);
+
+    std::shared_ptr<boost::asio::ssl::context> m_ctx;
+    mutable std::mutex m_lock;
+    std::unordered_map<std::string, SSL_SESSION*> m_sessions;
+    size_t m_max_sessions;
+    bool m_enabled = true;
+    httb::tls_stats m_stats;
+};
+
+} // namespace httb
+
+#endif //HTTB_TLS_SESSION_CACHE_H
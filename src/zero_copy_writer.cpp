@@ -0,0 +1,229 @@
+/*!
+ * httb.
+ * zero_copy_writer.cpp
+ *
+ * \date 2019
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+#include "zero_copy_writer.h"
+
+#include <algorithm>
+#include <boost/asio/bind_executor.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/beast/http/write.hpp>
+#include <cerrno>
+#include <sstream>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+#endif
+
+/// \brief Linux sendfile transfers at most this many bytes per call
+static const uint64_t MAX_SENDFILE_SIZE = 0x7ffff000;
+
+static const std::vector<httb::body_segment>& segments_of(const httb::zero_copy_writer::request_t& request) {
+    static const std::vector<httb::body_segment> empty;
+    const auto* segments = request.body().source ? request.body().source->segments() : nullptr;
+    return segments ? *segments : empty;
+}
+
+bool httb::zero_copy_writer::supported(const request_t& request, bool ssl) {
+#ifdef __linux__
+    return !ssl && request.body().source && request.body().source->segments();
+#else
+    return false;
+#endif
+}
+
+httb::zero_copy_writer::zero_copy_writer(boost::asio::ip::tcp::socket& socket, const request_t& request)
+    : m_socket(socket),
+      m_segments(segments_of(request)) {
+    std::stringstream ss;
+    ss << request.base();
+    m_header = ss.str();
+}
+
+httb::zero_copy_writer::~zero_copy_writer() {
+    close_file();
+}
+
+void httb::zero_copy_writer::write(boost::system::error_code& ec) {
+    ec = {};
+    while (true) {
+        if (m_fd < 0) {
+            gather();
+            if (!m_gather.empty()) {
+                m_written += boost::asio::write(m_socket, m_gather, ec);
+                if (ec) {
+                    return;
+                }
+                continue;
+            }
+            if (m_idx == m_segments.size()) {
+                return;
+            }
+            open_file(ec);
+            if (ec) {
+                return;
+            }
+        }
+
+        if (send_file(ec)) {
+            // socket is in non-blocking mode
+            m_socket.wait(boost::asio::ip::tcp::socket::wait_write, ec);
+        }
+        if (ec) {
+            return;
+        }
+    }
+}
+
+void httb::zero_copy_writer::async_write(const boost::asio::executor& ex, handler_func handler) {
+    m_executor = ex;
+    m_handler = std::move(handler);
+    boost::system::error_code ec;
+    // sendfile must not block event loop
+    if (!m_socket.native_non_blocking()) {
+        m_socket.native_non_blocking(true, ec);
+        m_restore_blocking = !ec;
+    }
+    if (ec) {
+        finish(ec);
+        return;
+    }
+    step();
+}
+
+void httb::zero_copy_writer::gather() {
+    m_gather.clear();
+    if (!m_header_sent) {
+        m_header_sent = true;
+        m_gather.emplace_back(m_header.data(), m_header.size());
+    }
+    while (m_idx < m_segments.size() && m_segments[m_idx].path.empty()) {
+        const auto& data = m_segments[m_idx].data;
+        if (!data.empty()) {
+            m_gather.emplace_back(data.data(), data.size());
+        }
+        m_idx++;
+    }
+}
+
+void httb::zero_copy_writer::open_file(boost::system::error_code& ec) {
+    const httb::body_segment& segment = m_segments[m_idx++];
+    m_offset = static_cast<int64_t>(segment.offset);
+    m_remaining = segment.size;
+#ifdef __linux__
+    m_fd = ::open(segment.path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (m_fd < 0) {
+        ec.assign(errno, boost::system::system_category());
+    }
+#else
+    ec = boost::asio::error::operation_not_supported;
+#endif
+}
+
+void httb::zero_copy_writer::close_file() {
+#ifdef __linux__
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+#endif
+    m_fd = -1;
+}
+
+bool httb::zero_copy_writer::send_file(boost::system::error_code& ec) {
+#ifdef __linux__
+    while (m_remaining > 0) {
+        off_t offset = static_cast<off_t>(m_offset);
+        const ssize_t sent = ::sendfile(m_socket.native_handle(), m_fd, &offset, std::min(m_remaining, MAX_SENDFILE_SIZE));
+        if (sent > 0) {
+            m_offset = offset;
+            m_remaining -= static_cast<uint64_t>(sent);
+            m_written += static_cast<size_t>(sent);
+            continue;
+        }
+        if (sent == 0) {
+            // file has been truncated after Content-Length was calculated
+            ec = boost::asio::error::eof;
+            return false;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return true;
+        }
+        ec.assign(errno, boost::system::system_category());
+        return false;
+    }
+#else
+    ec = boost::asio::error::operation_not_supported;
+#endif
+    close_file();
+    return false;
+}
+
+void httb::zero_copy_writer::step() {
+    boost::system::error_code ec;
+    while (true) {
+        if (m_fd < 0) {
+            gather();
+            if (!m_gather.empty()) {
+                auto self = shared_from_this();
+                boost::asio::async_write(m_socket, m_gather, boost::asio::bind_executor(m_executor, [self](boost::system::error_code ec, size_t written) {
+                    self->m_written += written;
+                    if (ec) {
+                        self->finish(ec);
+                        return;
+                    }
+                    self->step();
+                }));
+                return;
+            }
+            if (m_idx == m_segments.size()) {
+                finish({});
+                return;
+            }
+            open_file(ec);
+            if (ec) {
+                finish(ec);
+                return;
+            }
+        }
+
+        const bool wouldBlock = send_file(ec);
+        if (ec) {
+            finish(ec);
+            return;
+        }
+        if (wouldBlock) {
+            auto self = shared_from_this();
+            m_socket.async_wait(boost::asio::ip::tcp::socket::wait_write, boost::asio::bind_executor(m_executor, [self](boost::system::error_code ec) {
+                if (ec) {
+                    self->finish(ec);
+                    return;
+                }
+                self->step();
+            }));
+            return;
+        }
+    }
+}
+
+void httb::zero_copy_writer::finish(boost::system::error_code ec) {
+    close_file();
+    if (m_restore_blocking) {
+        boost::system::error_code ignored;
+        m_socket.native_non_blocking(false, ignored);
+    }
+    auto handler = std::move(m_handler);
+    m_handler = nullptr;
+    if (handler) {
+        handler(ec, m_written);
+    }
+}
@@ -0,0 +1,84 @@
+/*!
+ * httb.
+ * zero_copy_writer.h
+ *
+ * \date 2019
+ * \author Eduard Maximovich (edward.vstock@gmail.com)
+ * \link   https://github.com/edwardstock
+ */
+
+#ifndef HTTB_ZERO_COPY_WRITER_H
+#define HTTB_ZERO_COPY_WRITER_H
+
+#include "httb/types.h"
+
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/executor.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/http/message.hpp>
+#include <boost/system/error_code.hpp>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace httb {
+
+/// \brief Writes request with segmented body (see body_source::segments()) to plain tcp socket without copying files
+/// through user space: request header and in-memory segments between files are gathered into single writev,
+/// file regions are sent by sendfile(2) right from page cache. Linux only
+class zero_copy_writer : public std::enable_shared_from_this<zero_copy_writer> {
+public:
+    using request_t = boost::beast::http::request<httb::request_body_type>;
+    /// \brief Write callback: error and bytes written
+    using handler_func = std::function<void(boost::system::error_code, size_t)>;
+
+    /// \brief Whether request can be written by zero_copy_writer
+    /// \param request
+    /// \param ssl connection is encrypted: data must pass through user space anyway
+    static bool supported(const request_t& request, bool ssl);
+
+    /// \param socket connected socket, must outlive writer
+    /// \param request must outlive writer
+    zero_copy_writer(boost::asio::ip::tcp::socket& socket, const request_t& request);
+    ~zero_copy_writer();
+
+    /// \brief Write request synchronously
+    /// \param ec
+    void write(boost::system::error_code& ec);
+
+    /// \brief Write request asynchronously. Writer must be owned by shared_ptr
+    /// \param ex executor (strand) writer steps run on, socket is not touched outside of it
+    /// \param handler called on ex
+    void async_write(const boost::asio::executor& ex, handler_func handler);
+
+private:
+    boost::asio::ip::tcp::socket& m_socket;
+    boost::asio::executor m_executor;
+    const std::vector<httb::body_segment>& m_segments;
+    std::string m_header;
+    bool m_header_sent = false;
+    size_t m_idx = 0;
+    std::vector<boost::asio::const_buffer> m_gather;
+    int m_fd = -1;
+    int64_t m_offset = 0;
+    uint64_t m_remaining = 0;
+    size_t m_written = 0;
+    bool m_restore_blocking = false;
+    handler_func m_handler;
+
+    /// \brief Collect header and in-memory segments up to next file
+    void gather();
+    /// \brief Open file of next segment
+    void open_file(boost::system::error_code& ec);
+    void close_file();
+    /// \brief Send current file until it's done or socket buffer is full
+    /// \return true if socket would block
+    bool send_file(boost::system::error_code& ec);
+    void step();
+    void finish(boost::system::error_code ec);
+};
+
+} // namespace httb
+
+#endif //HTTB_ZERO_COPY_WRITER_H
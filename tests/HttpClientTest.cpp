@@ -10,17 +10,24 @@
 #include "httb/body_string.h"
 
 #include "gtest/gtest.h"
+#include <algorithm>
+#include <atomic>
+#include <boost/filesystem.hpp>
 #include <chrono>
 #include <fstream>
 #include <functional>
+#include <future>
 #include <httb/httb.h>
 #include <httb/mocker/mock_client.h>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
 #include <thread>
 #include <toolbox/io.h>
+#include <type_traits>
+#include <vector>
 
 static const httb::request_executor simple_resp_executor = ([](const httb::request& request) {
     httb::response resp;
@@ -512,6 +519,167 @@ TEST(HttpClientBatchTest, TestRunAll) {
     ASSERT_EQ(n, respN);
 }
 
+TEST(HttpClientBatchTest, TestRunOnWorkerThreads) {
+    // nobody listens on this port: requests fail fast without network
+    httb::request req("http://127.0.0.1:1/get");
+    httb::batch_request batch(4);
+    batch.set_work_stealing(true);
+
+    int n = 500;
+    for (int i = 0; i < n; i++) {
+        batch.add(req);
+    }
+
+    int respN = 0, failedN = 0;
+    batch.run_all([&respN, &failedN](httb::response res) {
+        // calls are serialized, no need to sync
+        respN++;
+        if (!res.success()) {
+            failedN++;
+        }
+    });
+
+    ASSERT_EQ(n, respN);
+    ASSERT_EQ(n, failedN);
+
+    // queue is drained
+    batch.run_all([&respN](const std::vector<httb::response>& res) {
+        respN = res.size();
+    });
+    ASSERT_EQ(0, respN);
+}
+
+TEST(HttpClientBatchTest, TestLazySourceWithWindow) {
+    httb::batch_request batch(2);
+    batch.set_max_in_flight(8);
+    batch.add(httb::request("http://127.0.0.1:1/get"));
+
+    const size_t n = 2000;
+    size_t generated = 0, done = 0, maxAhead = 0;
+    batch.set_source([&generated, n](httb::request& out) {
+        if (generated == n) {
+            return false;
+        }
+        generated++;
+        out = httb::request("http://127.0.0.1:1/get");
+        return true;
+    });
+
+    batch.run_all([&generated, &done, &maxAhead](httb::response) {
+        done++;
+        maxAhead = std::max(maxAhead, generated + 1 - done);
+    });
+
+    ASSERT_EQ(n + 1, done);
+    // requests are built lazily, not all at once
+    ASSERT_LT(maxAhead, (size_t) 100);
+}
+
+TEST(HttpClientBatchTest, TestPerHostLimit) {
+    httb::batch_request batch(3);
+    batch.set_max_in_flight(6);
+    batch.set_max_in_flight_per_host(2);
+
+    // hosts are not balanced: window must not be blocked by requests of one host
+    int n = 300;
+    for (int i = 0; i < n; i++) {
+        batch.add(httb::request(i % 10 == 0 ? "http://127.0.0.2:1/get" : "http://127.0.0.1:1/get"));
+    }
+
+    size_t respN = 0;
+    batch.run_all([&respN](const std::vector<httb::response>& res) {
+        respN = res.size();
+    });
+
+    ASSERT_EQ((size_t) n, respN);
+}
+
+TEST(HttpClientBatchTest, TestAdaptiveConcurrency) {
+    httb::batch_request batch(2);
+    ASSERT_EQ(0u, batch.get_client().get_concurrency_limit("127.0.0.1", 1));
+
+    batch.get_client().set_adaptive_concurrency(httb::limit_algorithm::aimd, 10, 2, 100);
+    ASSERT_EQ(10u, batch.get_client().get_concurrency_limit("127.0.0.1", 1));
+
+    int n = 100;
+    for (int i = 0; i < n; i++) {
+        batch.add(httb::request("http://127.0.0.1:1/get"));
+    }
+
+    int respN = 0;
+    batch.run_all([&respN](httb::response) {
+        respN++;
+    });
+
+    ASSERT_EQ(n, respN);
+    // every request failed: limit is decreased down to minimum
+    ASSERT_EQ(2u, batch.get_client().get_concurrency_limit("127.0.0.1", 1));
+    ASSERT_EQ(1u, batch.get_client().get_concurrency_limits().size());
+}
+
+TEST(HttpClientBatchTest, TestRunAllSubmissionOrder) {
+    httb::batch_request batch(4);
+    for (int i = 0; i < 100; i++) {
+        batch.add(httb::request("http://127.0.0.1:1/" + std::to_string(i)));
+    }
+    int generated = 100;
+    batch.set_source([&generated](httb::request& out) {
+        if (generated == 500) {
+            return false;
+        }
+        out = httb::request("http://127.0.0.1:1/" + std::to_string(generated++));
+        return true;
+    });
+
+    std::vector<httb::batch_result> results;
+    batch.run_all([&results](std::vector<httb::batch_result> res) {
+        results = std::move(res);
+    });
+
+    ASSERT_EQ(500u, results.size());
+    for (size_t i = 0; i < results.size(); i++) {
+        ASSERT_EQ("/" + std::to_string(i), results[i].request.get_path());
+        ASSERT_FALSE(results[i].response.success());
+    }
+}
+
+TEST(HttpClientBatchTest, TestFailFastCancelsInFlight) {
+    // listener never accepts: connections hang on reading response until cancelled
+    boost::asio::io_context ioc;
+    boost::asio::ip::tcp::acceptor acceptor(ioc, boost::asio::ip::tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0));
+    const std::string hangUrl = "http://127.0.0.1:" + std::to_string(acceptor.local_endpoint().port()) + "/hang";
+
+    httb::batch_request batch(2);
+    batch.set_completion_policy(httb::completion_policy::fail_fast);
+    batch.add(httb::request(hangUrl));
+    batch.add(httb::request(hangUrl));
+    batch.add(httb::request("http://127.0.0.1:1/refused"));
+    int generated = 0;
+    batch.set_source([&generated, &hangUrl](httb::request& out) {
+        if (generated == 10000) {
+            return false;
+        }
+        generated++;
+        out = httb::request(hangUrl);
+        return true;
+    });
+
+    const auto started = std::chrono::steady_clock::now();
+    std::vector<httb::batch_result> results;
+    batch.run_all([&results](std::vector<httb::batch_result> res) {
+        results = std::move(res);
+    });
+    const auto elapsed = std::chrono::steady_clock::now() - started;
+
+    ASSERT_LT(elapsed, std::chrono::seconds(5));
+    ASSERT_LT(generated, 10000);
+    ASSERT_EQ("/refused", results[2].request.get_path());
+    ASSERT_FALSE(results[2].response.success());
+    const int aborted = httb::response::INTERNAL_ERROR_OFFSET + boost::asio::error::operation_aborted;
+    ASSERT_EQ(aborted, results[0].response.code);
+    ASSERT_EQ(aborted, results[1].response.code);
+}
+
 TEST(HttpClientTest, TestAsyncGetWithRedirectAndEnabledFollow) {
     httb::request
         req("http://www.boost.org/doc/libs/develop/libs/beast/doc/html/beast/using_http/message_containers.html");
@@ -542,6 +710,1076 @@ TEST(HttpClientTest, TestReusingClientInstance) {
     ASSERT_EQ(resp2.code, 200);
 }
 
+TEST(HttpClientTest, TestKeepAliveConnectionReuse) {
+    httb::request
+        req("https://www.boost.org/doc/libs/develop/libs/beast/doc/html/beast/using_http/message_containers.html");
+    httb::client client;
+    httb::response resp1 = client.execute_blocking(req);
+    ASSERT_TRUE(resp1.success());
+
+    httb::context ctx;
+    httb::response resp2;
+    client.execute_in_context(ctx, req, [&resp2](httb::response result) {
+        resp2 = result;
+    });
+    ctx.run();
+    ASSERT_TRUE(resp2.success());
+
+    httb::response resp3 = client.execute_blocking(req);
+    ASSERT_TRUE(resp3.success());
+
+    // blocking and async calls use different io contexts, so each of them opens own connection
+    const httb::connection_stats stats = client.get_connection_stats();
+    ASSERT_EQ(2u, stats.created);
+    ASSERT_EQ(1u, stats.reused);
+
+    client.set_keep_alive(false);
+    httb::response resp4 = client.execute_blocking(req);
+    ASSERT_TRUE(resp4.success());
+    ASSERT_EQ(3u, client.get_connection_stats().created);
+    ASSERT_EQ(0u, client.get_connection_stats().idle);
+}
+
+TEST(HttpClientTest, TestStaleConnectionRetry) {
+    boost::asio::io_context serverCtx;
+    boost::asio::ip::tcp::acceptor acceptor(serverCtx, boost::asio::ip::tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0));
+    const uint16_t port = acceptor.local_endpoint().port();
+    std::vector<std::string> methods;
+    std::thread server([&acceptor, &serverCtx, &methods]() {
+        namespace http = boost::beast::http;
+        // every connection answers first request, then reads second one and closes without response, like server
+        // which closes idle connection at the same time; last connection answers only one request
+        for (int i = 0; i < 4; i++) {
+            boost::asio::ip::tcp::socket socket(serverCtx);
+            acceptor.accept(socket);
+            boost::beast::flat_buffer buffer;
+            for (int j = 0; j < 2; j++) {
+                http::request<http::string_body> req;
+                boost::system::error_code ec;
+                http::read(socket, buffer, req, ec);
+                if (ec) {
+                    break;
+                }
+                methods.push_back(req.method_string().to_string());
+                if (j == 1) {
+                    break;
+                }
+                boost::asio::write(socket, boost::asio::buffer(std::string("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok")), ec);
+                if (i == 3) {
+                    break;
+                }
+            }
+        }
+    });
+
+    const std::string url = "http://127.0.0.1:" + std::to_string(port);
+    httb::request get(url + "/get");
+    httb::request post(url + "/post", httb::request::method::post);
+    post.set_body(std::string("data"));
+    httb::client client;
+
+    // server could have processed written POST: it's not sent again
+    ASSERT_EQ(200, client.execute_blocking(get).code);
+    ASSERT_TRUE(client.execute_blocking(post).is_internal_error());
+
+    httb::context ctx;
+    httb::response resp;
+    auto run = [&client, &ctx, &resp](const httb::request& req) {
+        client.execute_in_context(ctx, req, [&resp](httb::response result) {
+            resp = std::move(result);
+        });
+        ctx.restart();
+        ctx.run();
+        return resp;
+    };
+    ASSERT_EQ(200, run(get).code);
+    ASSERT_TRUE(run(post).is_internal_error());
+
+    // GET is repeated over new connection
+    ASSERT_EQ(200, run(get).code);
+    ASSERT_EQ(200, run(get).code);
+    server.join();
+
+    const std::vector<std::string> expected{"GET", "POST", "GET", "POST", "GET", "GET", "GET"};
+    ASSERT_EQ(expected, methods);
+}
+
+TEST(HttpClientTest, TestTlsSessionResumption) {
+    httb::request
+        req("https://www.boost.org/doc/libs/develop/libs/beast/doc/html/beast/using_http/message_containers.html");
+    httb::client client;
+    // force new connection for each request
+    client.set_keep_alive(false);
+
+    httb::response resp1 = client.execute_blocking(req);
+    ASSERT_TRUE(resp1.success());
+
+    httb::response resp2;
+    client.execute(req, [&resp2](httb::response result) {
+        resp2 = result;
+    });
+    ASSERT_TRUE(resp2.success());
+
+    const httb::tls_stats stats = client.get_tls_stats();
+    ASSERT_EQ(1u, stats.full_handshakes);
+    ASSERT_EQ(1u, stats.resumed_handshakes);
+}
+
+TEST(HttpClientTest, TestKtls) {
+    httb::request
+        req("https://www.boost.org/doc/libs/develop/libs/beast/doc/html/beast/using_http/message_containers.html");
+    httb::client client;
+    client.set_keep_alive(false);
+    client.set_ktls(true);
+
+    // works with or without offload: kernel without "tls" module falls back to user space encryption
+    httb::response resp1 = client.execute_blocking(req);
+    ASSERT_TRUE(resp1.success());
+
+    httb::response resp2;
+    client.execute(req, [&resp2](httb::response result) {
+        resp2 = result;
+    });
+    ASSERT_TRUE(resp2.success());
+    ASSERT_EQ(resp1.get_body(), resp2.get_body());
+
+    const httb::tls_stats stats = client.get_tls_stats();
+    ASSERT_EQ(2u, stats.full_handshakes + stats.resumed_handshakes);
+    ASSERT_EQ(resp1.ktls.send + resp2.ktls.send, stats.ktls_send);
+    ASSERT_EQ(resp1.ktls.receive + resp2.ktls.receive, stats.ktls_receive);
+    ASSERT_EQ(2u, stats.ktls_send + stats.ktls_fallbacks);
+}
+
+TEST(HttpClientTest, TestDnsResolveOverride) {
+    httb::client client;
+    client.set_connection_timeout(5);
+    // nobody listens on this port, but host must be resolved without DNS
+    client.add_resolve_override("httb.test", 1, "127.0.0.1");
+
+    httb::response resp1 = client.execute_blocking(httb::request("http://httb.test:1/get"));
+    ASSERT_FALSE(resp1.success());
+
+    httb::response resp2;
+    client.execute(httb::request("http://httb.test:1/get"), [&resp2](httb::response result) {
+        resp2 = result;
+    });
+    ASSERT_FALSE(resp2.success());
+
+    const httb::dns_stats stats = client.get_dns_stats();
+    ASSERT_EQ(2u, stats.hits);
+    ASSERT_EQ(0u, stats.misses);
+    ASSERT_THROW(client.add_resolve_override("httb.test", 1, "not-an-ip"), boost::system::system_error);
+}
+
+TEST(HttpClientTest, TestHappyEyeballsConnect) {
+    httb::client client;
+    client.set_connection_timeout(5);
+    client.set_connect_strategy(httb::connect_strategy::happy_eyeballs, 50);
+    // all addresses refuse connection: racing must fail with last error, not wait whole connection timeout
+    client.add_resolve_override("httb.test", 1, "127.0.0.1");
+    client.add_resolve_override("httb.test", 1, "127.0.0.2");
+
+    const auto start = std::chrono::steady_clock::now();
+    httb::response resp1 = client.execute_blocking(httb::request("http://httb.test:1/get"));
+    ASSERT_FALSE(resp1.success());
+
+    httb::response resp2;
+    client.execute(httb::request("http://httb.test:1/get"), [&resp2](httb::response result) {
+        resp2 = result;
+    });
+    ASSERT_FALSE(resp2.success());
+    ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+}
+
+TEST(HttpClientTest, TestHedgedRequest) {
+    // first connection never gets response, second one gets it immediately
+    boost::asio::io_context serverCtx;
+    boost::asio::ip::tcp::acceptor acceptor(serverCtx, boost::asio::ip::tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0));
+    const uint16_t port = acceptor.local_endpoint().port();
+    std::thread server([&acceptor, &serverCtx]() {
+        boost::asio::ip::tcp::socket slow(serverCtx);
+        boost::asio::ip::tcp::socket fast(serverCtx);
+        acceptor.accept(slow);
+        acceptor.accept(fast);
+        boost::asio::streambuf buffer;
+        boost::asio::read_until(fast, buffer, "\r\n\r\n");
+        boost::asio::write(fast, boost::asio::buffer(std::string("HTTP/1.1 200 OK\r\nContent-Length: 4\r\n\r\nfast")));
+        boost::system::error_code ec;
+        boost::asio::read(slow, buffer, ec);
+    });
+
+    httb::client client;
+    client.set_keep_alive(false);
+    client.set_hedging(true, 1.0);
+    client.set_hedge_delay(50);
+
+    httb::request req("http://127.0.0.1:" + std::to_string(port) + "/get");
+    ASSERT_TRUE(req.is_idempotent());
+    const auto start = std::chrono::steady_clock::now();
+    httb::response resp;
+    client.execute(req, [&resp](httb::response result) {
+        resp = result;
+    });
+    ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+    // loser is cancelled: its socket is closed, so server thread finishes
+    server.join();
+
+    ASSERT_EQ(200, resp.code);
+    ASSERT_EQ("fast", resp.get_body());
+    const httb::hedge_stats stats = client.get_hedge_stats();
+    ASSERT_EQ(1u, stats.requests);
+    ASSERT_EQ(1u, stats.hedged);
+    ASSERT_EQ(1u, stats.hedge_wins);
+
+    httb::request post("http://127.0.0.1:1/post", httb::request::method::post);
+    ASSERT_FALSE(post.is_idempotent());
+}
+
+TEST(HttpClientTest, TestBlockingRequestNotHedged) {
+    // blocking request with deadline runs in event loop, but it's still not hedged
+    boost::asio::io_context serverCtx;
+    boost::asio::ip::tcp::acceptor acceptor(serverCtx, boost::asio::ip::tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0));
+    const uint16_t port = acceptor.local_endpoint().port();
+    std::thread server([&acceptor, &serverCtx]() {
+        boost::asio::ip::tcp::socket socket(serverCtx);
+        acceptor.accept(socket);
+        boost::asio::streambuf buffer;
+        boost::asio::read_until(socket, buffer, "\r\n\r\n");
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        boost::asio::write(socket, boost::asio::buffer(std::string("HTTP/1.1 200 OK\r\nContent-Length: 4\r\n\r\nslow")));
+    });
+
+    httb::client client;
+    client.set_keep_alive(false);
+    client.set_hedging(true, 1.0);
+    client.set_hedge_delay(20);
+    client.set_deadline(std::chrono::seconds(5));
+    httb::response resp = client.execute_blocking(httb::request("http://127.0.0.1:" + std::to_string(port) + "/get"));
+    server.join();
+
+    ASSERT_EQ(200, resp.code);
+    ASSERT_EQ("slow", resp.get_body());
+    ASSERT_EQ(0u, client.get_hedge_stats().requests);
+    ASSERT_EQ(0u, client.get_hedge_stats().hedged);
+}
+
+TEST(HttpClientTest, TestRetryWithBudget) {
+    httb::client client;
+    client.set_retry(3, 20, 100);
+    httb::request req("http://127.0.0.1:1/get");
+
+    auto start = std::chrono::steady_clock::now();
+    httb::response resp1 = client.execute_blocking(req);
+    ASSERT_FALSE(resp1.success());
+    ASSERT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(60));
+    ASSERT_EQ(3u, client.get_retry_stats().retries);
+    ASSERT_EQ(1u, client.get_retry_stats().exhausted);
+
+    start = std::chrono::steady_clock::now();
+    httb::response resp2;
+    client.execute(req, [&resp2](httb::response result) {
+        resp2 = result;
+    });
+    ASSERT_FALSE(resp2.success());
+    ASSERT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(60));
+    ASSERT_EQ(6u, client.get_retry_stats().retries);
+
+    // single token and no deposits: only one retry allowed
+    client.set_retry_budget(0, 1);
+    client.execute_blocking(req);
+    client.execute_blocking(req);
+    ASSERT_EQ(7u, client.get_retry_stats().retries);
+    ASSERT_EQ(2u, client.get_retry_stats().budget_exhausted);
+}
+
+TEST(HttpClientTest, TestRetryFirstDelayJitter) {
+    // first retry delay is random between base and 3x base: clients failed together don't retry together
+    httb::request req("http://127.0.0.1:1/get");
+    std::vector<std::chrono::steady_clock::duration> delays;
+    for (int i = 0; i < 8; i++) {
+        httb::client client;
+        client.set_retry(1, 50, 1000);
+        const auto start = std::chrono::steady_clock::now();
+        httb::response resp = client.execute_blocking(req);
+        delays.push_back(std::chrono::steady_clock::now() - start);
+        ASSERT_FALSE(resp.success());
+        ASSERT_EQ(1u, client.get_retry_stats().retries);
+        ASSERT_GE(delays.back(), std::chrono::milliseconds(50));
+    }
+    const auto bounds = std::minmax_element(delays.begin(), delays.end());
+    ASSERT_GT(*bounds.second - *bounds.first, std::chrono::milliseconds(10));
+}
+
+TEST(HttpClientTest, TestRetryBeyondDeadlineKeepsBudget) {
+    httb::client client;
+    client.set_retry(3, 200, 1000);
+    // single token and no deposits
+    client.set_retry_budget(0, 1);
+
+    // any backoff is longer than deadline: retry is skipped and doesn't take token
+    httb::request shortReq("http://127.0.0.1:1/get");
+    shortReq.set_deadline(std::chrono::milliseconds(100));
+    ASSERT_FALSE(client.execute_blocking(shortReq).success());
+    ASSERT_EQ(0u, client.get_retry_stats().retries);
+    ASSERT_EQ(1u, client.get_retry_stats().exhausted);
+
+    ASSERT_FALSE(client.execute_blocking(httb::request("http://127.0.0.1:1/get")).success());
+    ASSERT_EQ(1u, client.get_retry_stats().retries);
+    ASSERT_EQ(1u, client.get_retry_stats().budget_exhausted);
+}
+
+TEST(HttpClientTest, TestRetryAfter) {
+    // first response asks to retry in 1 second, second one is successful
+    boost::asio::io_context serverCtx;
+    boost::asio::ip::tcp::acceptor acceptor(serverCtx, boost::asio::ip::tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0));
+    const uint16_t port = acceptor.local_endpoint().port();
+    std::thread server([&acceptor, &serverCtx]() {
+        const std::string responses[] = {
+            "HTTP/1.1 503 Service Unavailable\r\nRetry-After: 1\r\nContent-Length: 0\r\nConnection: close\r\n\r\n",
+            "HTTP/1.1 200 OK\r\nContent-Length: 2\r\nConnection: close\r\n\r\nok",
+        };
+        for (const auto& response : responses) {
+            boost::asio::ip::tcp::socket socket(serverCtx);
+            acceptor.accept(socket);
+            boost::asio::streambuf buffer;
+            boost::asio::read_until(socket, buffer, "\r\n\r\n");
+            boost::asio::write(socket, boost::asio::buffer(response));
+        }
+    });
+
+    httb::client client;
+    client.set_retry(2, 10, 5000);
+    const auto start = std::chrono::steady_clock::now();
+    httb::response resp;
+    client.execute(httb::request("http://127.0.0.1:" + std::to_string(port) + "/get"), [&resp](httb::response result) {
+        resp = result;
+    });
+    server.join();
+
+    ASSERT_EQ(200, resp.code);
+    ASSERT_EQ("ok", resp.get_body());
+    ASSERT_GE(std::chrono::steady_clock::now() - start, std::chrono::seconds(1));
+    ASSERT_EQ(1u, client.get_retry_stats().retries);
+}
+
+TEST(HttpClientTest, TestRetryErrorCategory) {
+    // server closes connection without response: http end_of_stream has same value as beast timeout, but it's not retryable
+    boost::asio::io_context serverCtx;
+    boost::asio::ip::tcp::acceptor acceptor(serverCtx, boost::asio::ip::tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0));
+    const uint16_t port = acceptor.local_endpoint().port();
+    std::atomic<int> connections(0);
+    std::function<void()> accept = [&acceptor, &connections, &accept]() {
+        acceptor.async_accept([&connections, &accept](boost::system::error_code ec, boost::asio::ip::tcp::socket socket) {
+            if (ec) {
+                return;
+            }
+            connections++;
+            boost::asio::streambuf buffer;
+            boost::asio::read_until(socket, buffer, "\r\n\r\n", ec);
+            socket.close(ec);
+            accept();
+        });
+    };
+    accept();
+    std::thread server([&serverCtx]() {
+        serverCtx.run();
+    });
+
+    httb::client client;
+    client.set_keep_alive(false);
+    client.set_retry(2, 10, 100);
+    httb::response resp = client.execute_blocking(httb::request("http://127.0.0.1:" + std::to_string(port) + "/get"));
+    serverCtx.stop();
+    server.join();
+
+    ASSERT_EQ(httb::response::INTERNAL_ERROR_OFFSET + static_cast<int>(boost::beast::http::error::end_of_stream), resp.code);
+    ASSERT_EQ(static_cast<int>(boost::beast::http::error::end_of_stream), static_cast<int>(boost::beast::error::timeout));
+    ASSERT_FALSE(resp.retryable);
+    ASSERT_EQ(1, connections.load());
+    ASSERT_EQ(0u, client.get_retry_stats().retries);
+}
+
+TEST(HttpClientTest, TestCircuitBreaker) {
+    // take free port, nobody listens on it until server started
+    boost::asio::io_context serverCtx;
+    boost::asio::ip::tcp::acceptor acceptor(serverCtx, boost::asio::ip::tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0));
+    const boost::asio::ip::tcp::endpoint endpoint = acceptor.local_endpoint();
+    acceptor.close();
+
+    httb::client client;
+    client.set_circuit_breaker(true, 3, 0, 200, 1);
+    std::mutex transitionsLock;
+    std::vector<std::pair<httb::circuit_state, httb::circuit_state>> transitions;
+    client.set_circuit_listener([&transitionsLock, &transitions](const std::string&, uint16_t, httb::circuit_state from, httb::circuit_state to) {
+        std::lock_guard<std::mutex> lock(transitionsLock);
+        transitions.emplace_back(from, to);
+    });
+
+    httb::request req("http://127.0.0.1:" + std::to_string(endpoint.port()) + "/get");
+    for (int i = 0; i < 3; i++) {
+        ASSERT_LT(client.execute_blocking(req).code, httb::response::CIRCUIT_OPEN);
+    }
+    ASSERT_EQ(httb::circuit_state::open, client.get_circuit_state("127.0.0.1", endpoint.port()));
+    ASSERT_EQ(httb::response::CIRCUIT_OPEN, client.execute_blocking(req).code);
+    httb::response asyncResp;
+    client.execute(req, [&asyncResp](httb::response result) {
+        asyncResp = result;
+    });
+    ASSERT_EQ(httb::response::CIRCUIT_OPEN, asyncResp.code);
+
+    // failed probe opens breaker again
+    std::this_thread::sleep_for(std::chrono::milliseconds(250));
+    ASSERT_LT(client.execute_blocking(req).code, httb::response::CIRCUIT_OPEN);
+    ASSERT_EQ(httb::circuit_state::open, client.get_circuit_state("127.0.0.1", endpoint.port()));
+
+    // successful probe closes it
+    acceptor.open(endpoint.protocol());
+    acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+    acceptor.bind(endpoint);
+    acceptor.listen();
+    std::thread server([&acceptor, &serverCtx]() {
+        boost::asio::ip::tcp::socket socket(serverCtx);
+        acceptor.accept(socket);
+        boost::asio::streambuf buffer;
+        boost::asio::read_until(socket, buffer, "\r\n\r\n");
+        boost::asio::write(socket, boost::asio::buffer(std::string("HTTP/1.1 200 OK\r\nContent-Length: 0\r\nConnection: close\r\n\r\n")));
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(250));
+    ASSERT_EQ(200, client.execute_blocking(req).code);
+    server.join();
+    ASSERT_EQ(httb::circuit_state::closed, client.get_circuit_state("127.0.0.1", endpoint.port()));
+
+    std::lock_guard<std::mutex> lock(transitionsLock);
+    const std::vector<std::pair<httb::circuit_state, httb::circuit_state>> expected{
+        {httb::circuit_state::closed, httb::circuit_state::open},
+        {httb::circuit_state::open, httb::circuit_state::half_open},
+        {httb::circuit_state::half_open, httb::circuit_state::open},
+        {httb::circuit_state::open, httb::circuit_state::half_open},
+        {httb::circuit_state::half_open, httb::circuit_state::closed},
+    };
+    ASSERT_EQ(expected, transitions);
+}
+
+TEST(HttpClientTest, TestRequestDeadline) {
+    // listener never accepts: connection is established by kernel, but response never comes
+    boost::asio::io_context serverCtx;
+    boost::asio::ip::tcp::acceptor acceptor(serverCtx, boost::asio::ip::tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0));
+    httb::request req("http://127.0.0.1:" + std::to_string(acceptor.local_endpoint().port()) + "/hang");
+    req.set_deadline(std::chrono::microseconds(100500));
+
+    httb::client client;
+    client.set_read_timeout(10);
+    // caller's deadline is not host failure or overload
+    client.set_circuit_breaker(true, 1, 0);
+    client.set_adaptive_concurrency(httb::limit_algorithm::aimd, 20);
+
+    auto started = std::chrono::steady_clock::now();
+    httb::response asyncResp;
+    client.execute(req, [&asyncResp](httb::response result) {
+        asyncResp = result;
+    });
+    auto elapsed = std::chrono::steady_clock::now() - started;
+    ASSERT_EQ(httb::response::DEADLINE_EXCEEDED, asyncResp.code);
+    ASSERT_GE(elapsed, std::chrono::microseconds(100500));
+    ASSERT_LT(elapsed, std::chrono::seconds(1));
+
+    // client-wide deadline, blocking request
+    req.set_deadline(std::chrono::steady_clock::duration::zero());
+    client.set_deadline(std::chrono::milliseconds(50));
+    started = std::chrono::steady_clock::now();
+    ASSERT_EQ(httb::response::DEADLINE_EXCEEDED, client.execute_blocking(req).code);
+    elapsed = std::chrono::steady_clock::now() - started;
+    ASSERT_GE(elapsed, std::chrono::milliseconds(50));
+    ASSERT_LT(elapsed, std::chrono::seconds(1));
+
+    ASSERT_EQ(httb::circuit_state::closed, client.get_circuit_state("127.0.0.1", acceptor.local_endpoint().port()));
+    ASSERT_EQ(20, client.get_concurrency_limit("127.0.0.1", acceptor.local_endpoint().port()));
+}
+
+TEST(HttpClientTest, TestCancelRequest) {
+    // listener never accepts: response never comes
+    boost::asio::io_context serverCtx;
+    boost::asio::ip::tcp::acceptor acceptor(serverCtx, boost::asio::ip::tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0));
+    httb::request req("http://127.0.0.1:" + std::to_string(acceptor.local_endpoint().port()) + "/hang");
+
+    httb::client client;
+    client.set_retry(3);
+    boost::asio::io_context ioc;
+    httb::response resp;
+    size_t calls = 0;
+    httb::request_handle handle = client.execute_in_context(ioc, req, [&resp, &calls](httb::response result) {
+        resp = result;
+        calls++;
+    });
+    ASSERT_TRUE(handle.valid());
+    ASSERT_FALSE(handle.cancelled());
+
+    std::thread canceller([handle]() mutable {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        handle.cancel();
+    });
+    const auto started = std::chrono::steady_clock::now();
+    // returns only when socket, timers and session are gone
+    ioc.run();
+    const auto elapsed = std::chrono::steady_clock::now() - started;
+    canceller.join();
+
+    ASSERT_TRUE(handle.cancelled());
+    ASSERT_EQ(1, calls);
+    ASSERT_EQ(httb::response::INTERNAL_ERROR_OFFSET + boost::asio::error::operation_aborted, resp.code);
+    ASSERT_LT(elapsed, std::chrono::seconds(1));
+
+    // cancelling completed request does nothing
+    handle.cancel();
+    ASSERT_EQ(1, calls);
+    httb::request_handle empty;
+    ASSERT_FALSE(empty.valid());
+    empty.cancel();
+}
+
+TEST(HttpClientTest, TestAsyncExecuteCompletionToken) {
+    boost::asio::io_context serverCtx;
+    boost::asio::ip::tcp::acceptor acceptor(serverCtx, boost::asio::ip::tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0));
+    const uint16_t port = acceptor.local_endpoint().port();
+    const size_t requests = 2;
+    std::thread server([&acceptor, &serverCtx]() {
+        for (size_t i = 0; i < requests; i++) {
+            boost::asio::ip::tcp::socket socket(serverCtx);
+            acceptor.accept(socket);
+            boost::asio::streambuf buffer;
+            boost::asio::read_until(socket, buffer, "\r\n\r\n");
+            const std::string body = "response " + std::to_string(i);
+            boost::asio::write(socket, boost::asio::buffer("HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(body.size()) +
+                                                           "\r\nConnection: close\r\n\r\n" + body));
+        }
+    });
+
+    httb::request req("http://127.0.0.1:" + std::to_string(port) + "/get");
+    httb::client client;
+    boost::asio::io_context ioc;
+
+    // move-only handler
+    auto flag = std::make_unique<bool>(true);
+    httb::response first;
+    client.async_execute(ioc, req, [&first, flag = std::move(flag)](httb::response resp) {
+        ASSERT_TRUE(*flag);
+        first = std::move(resp);
+    });
+    ioc.run();
+    ASSERT_EQ(200, first.code);
+    ASSERT_STREQ("response 0", first.get_body_c());
+
+    ioc.restart();
+    auto work = boost::asio::make_work_guard(ioc);
+    std::thread runner([&ioc]() {
+        ioc.run();
+    });
+    std::future<httb::response> second = client.async_execute(ioc, req, boost::asio::use_future);
+    ASSERT_STREQ("response 1", second.get().get_body_c());
+    work.reset();
+    runner.join();
+    server.join();
+}
+
+#if defined(BOOST_ASIO_HAS_CO_AWAIT)
+TEST(HttpClientTest, TestAsyncExecuteCoroutine) {
+    httb::client client;
+    boost::asio::io_context ioc;
+    httb::response resp;
+    boost::asio::co_spawn(
+        ioc, [&]() -> boost::asio::awaitable<void> {
+            resp = co_await client.async_execute(ioc, httb::request("http://127.0.0.1:1/"));
+        },
+        boost::asio::detached);
+    ioc.run();
+    ASSERT_EQ(httb::response::INTERNAL_ERROR_OFFSET + boost::asio::error::connection_refused, resp.code);
+}
+#endif
+
+TEST(HttpClientTest, TestEventLoop) {
+    // nothing listens on port 1: every request completes quickly with connection error
+    httb::request req("http://127.0.0.1:1/");
+    httb::client client;
+    ASSERT_THROW(client.async_execute(req, boost::asio::use_future), std::runtime_error);
+
+    client.set_event_loop(2);
+    const size_t producers = 8;
+    const size_t perProducer = 50;
+    std::atomic<size_t> callbacks(0);
+    std::atomic<size_t> callerThreadCalls(0);
+    std::vector<std::thread> threads;
+    std::vector<std::vector<std::future<httb::response>>> futures(producers);
+    for (size_t i = 0; i < producers; i++) {
+        threads.emplace_back([&client, &req, &callbacks, &callerThreadCalls, &futures, i]() {
+            const auto caller = std::this_thread::get_id();
+            for (size_t j = 0; j < perProducer; j++) {
+                futures[i].push_back(client.async_execute(req, boost::asio::use_future));
+                // returns immediately, callback is called on loop thread
+                client.execute(req, [&callbacks, &callerThreadCalls, caller](httb::response resp) {
+                    if (std::this_thread::get_id() == caller) {
+                        callerThreadCalls++;
+                    }
+                    callbacks++;
+                });
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    for (auto& list : futures) {
+        for (auto& future : list) {
+            ASSERT_EQ(httb::response::INTERNAL_ERROR_OFFSET + boost::asio::error::connection_refused, future.get().code);
+        }
+    }
+    const auto started = std::chrono::steady_clock::now();
+    while (callbacks < producers * perProducer && std::chrono::steady_clock::now() - started < std::chrono::seconds(5)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    ASSERT_EQ(producers * perProducer, callbacks.load());
+    ASSERT_EQ(0u, callerThreadCalls.load());
+
+    // loop can be stopped while client is alive
+    client.set_event_loop(0);
+    ASSERT_THROW(client.async_execute(req, boost::asio::use_future), std::runtime_error);
+}
+
+/// \brief Three blocking requests of client must go over single keep-alive connection
+static void check_blocking_connection_reuse(httb::client& client) {
+    boost::asio::io_context serverCtx;
+    boost::asio::ip::tcp::acceptor acceptor(serverCtx, boost::asio::ip::tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0));
+    const uint16_t port = acceptor.local_endpoint().port();
+    const size_t requests = 3;
+    // larger than read buffer kept between calls
+    const std::string body(100 * 1024, 'x');
+    std::thread server([&acceptor, &serverCtx, &body]() {
+        boost::asio::ip::tcp::socket socket(serverCtx);
+        acceptor.accept(socket);
+        boost::asio::streambuf buffer;
+        for (size_t i = 0; i < requests; i++) {
+            const size_t size = boost::asio::read_until(socket, buffer, "\r\n\r\n");
+            buffer.consume(size);
+            const std::string payload = i == 1 ? body : "response " + std::to_string(i);
+            boost::asio::write(socket, boost::asio::buffer("HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(payload.size()) +
+                                                           "\r\nKeep-Alive: timeout = 5 , max=100\r\n\r\n" + payload));
+        }
+    });
+
+    httb::request req("http://127.0.0.1:" + std::to_string(port) + "/get");
+    ASSERT_STREQ("response 0", client.execute_blocking(req).get_body_c());
+    ASSERT_EQ(body, client.execute_blocking(req).get_body());
+    ASSERT_STREQ("response 2", client.execute_blocking(req).get_body_c());
+    server.join();
+
+    const httb::connection_stats stats = client.get_connection_stats();
+    ASSERT_EQ(1u, stats.created);
+    ASSERT_EQ(2u, stats.reused);
+}
+
+TEST(HttpClientTest, TestBlockingConnectionReuse) {
+    httb::client client;
+    check_blocking_connection_reuse(client);
+}
+
+TEST(HttpClientTest, TestBlockingConnectionReuseWithRetry) {
+    httb::client client;
+    client.set_retry(2);
+    check_blocking_connection_reuse(client);
+}
+
+TEST(HttpClientTest, TestBlockingConnectionReuseWithDeadline) {
+    httb::client client;
+    client.set_deadline(std::chrono::seconds(5));
+    check_blocking_connection_reuse(client);
+}
+
+TEST(HttpClientTest, TestAsyncLargeBodyMove) {
+    // response is moved through retry, hedge and redirect chain, copying would be silent and costly
+    static_assert(std::is_nothrow_move_constructible<httb::response>::value, "response must be movable");
+    static_assert(std::is_nothrow_move_assignable<httb::response>::value, "response must be movable");
+
+    boost::asio::io_context serverCtx;
+    boost::asio::ip::tcp::acceptor acceptor(serverCtx, boost::asio::ip::tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0));
+    const uint16_t port = acceptor.local_endpoint().port();
+    std::string body(4 * 1024 * 1024, 'x');
+    body.back() = 'y';
+    std::thread server([&acceptor, &serverCtx, &body]() {
+        boost::asio::ip::tcp::socket socket(serverCtx);
+        acceptor.accept(socket);
+        boost::asio::streambuf buffer;
+        boost::asio::read_until(socket, buffer, "\r\n\r\n");
+        boost::asio::write(socket, boost::asio::buffer("HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(body.size()) +
+                                                       "\r\nConnection: close\r\n\r\n" + body));
+    });
+
+    httb::client client;
+    httb::response resp;
+    client.execute(httb::request("http://127.0.0.1:" + std::to_string(port) + "/large"), [&resp](httb::response result) {
+        resp = std::move(result);
+    });
+    server.join();
+    ASSERT_EQ(200, resp.code);
+    ASSERT_EQ(body.size(), resp.get_body_size());
+    ASSERT_EQ(body, resp.get_body());
+}
+
+TEST(HttpClientTest, TestStreamResponseBody) {
+    boost::asio::io_context serverCtx;
+    boost::asio::ip::tcp::acceptor acceptor(serverCtx, boost::asio::ip::tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0));
+    const uint16_t port = acceptor.local_endpoint().port();
+    const std::string body(1024 * 1024, 'x');
+    std::thread server([&acceptor, &serverCtx, &body]() {
+        for (int i = 0; i < 2; i++) {
+            boost::asio::ip::tcp::socket socket(serverCtx);
+            acceptor.accept(socket);
+            boost::asio::streambuf buffer;
+            boost::asio::read_until(socket, buffer, "\r\n\r\n");
+            boost::system::error_code ec;
+            boost::asio::write(socket, boost::asio::buffer("HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(body.size()) +
+                                                           "\r\nConnection: close\r\n\r\n" + body), ec);
+        }
+    });
+
+    httb::client client;
+    client.set_read_timeout(5);
+    const httb::request req("http://127.0.0.1:" + std::to_string(port) + "/stream");
+
+    // first chunk pauses reading, resumed from other thread
+    boost::asio::io_context ioc;
+    std::atomic<size_t> chunks(0);
+    std::atomic<bool> paused(false);
+    size_t received = 0;
+    bool headersFirst = false;
+    std::string contentLength;
+    httb::response result;
+    httb::request_handle handle = client.execute_stream(
+        ioc, req,
+        [&](const httb::response& headers) {
+            headersFirst = chunks == 0 && headers.code == 200;
+            contentLength = headers.get_header_value("content-length");
+        },
+        [&](const char* data, size_t size) {
+            received += size;
+            if (chunks++ == 0) {
+                paused = true;
+                return false;
+            }
+            return true;
+        },
+        [&result](httb::response resp) {
+            result = std::move(resp);
+        });
+    std::thread resumer([&handle, &paused, &chunks]() {
+        while (!paused) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        // reading has been stopped
+        ASSERT_EQ(1, chunks.load());
+        handle.resume();
+    });
+    ioc.run();
+    resumer.join();
+
+    ASSERT_EQ(200, result.code);
+    ASSERT_TRUE(headersFirst);
+    ASSERT_EQ(std::to_string(body.size()), contentLength);
+    ASSERT_EQ(body.size(), received);
+    ASSERT_GT(chunks.load(), 1);
+    ASSERT_EQ(0, result.get_body_size());
+
+    // cancel while paused
+    ioc.restart();
+    httb::response cancelled;
+    httb::request_handle handle2 = client.execute_stream(
+        ioc, req, nullptr,
+        [&handle2](const char*, size_t) {
+            handle2.cancel();
+            return false;
+        },
+        [&cancelled](httb::response resp) {
+            cancelled = std::move(resp);
+        });
+    ioc.run();
+    server.join();
+    ASSERT_FALSE(cancelled.success());
+    ASSERT_EQ(httb::response::INTERNAL_ERROR_OFFSET + boost::asio::error::operation_aborted, cancelled.code);
+}
+
+TEST(HttpClientTest, TestDownloadToFile) {
+    boost::asio::io_context serverCtx;
+    boost::asio::ip::tcp::acceptor acceptor(serverCtx, boost::asio::ip::tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0));
+    const uint16_t port = acceptor.local_endpoint().port();
+    // not multiple of chunk and write buffer
+    std::string body(3 * 1024 * 1024 + 12345, 'x');
+    for (size_t i = 0; i < body.size(); i += 1000) {
+        body[i] = static_cast<char>('a' + (i / 1000) % 26);
+    }
+    std::thread server([&acceptor, &serverCtx, &body]() {
+        for (int i = 0; i < 3; i++) {
+            boost::asio::ip::tcp::socket socket(serverCtx);
+            acceptor.accept(socket);
+            boost::asio::streambuf buffer;
+            boost::asio::read_until(socket, buffer, "\r\n\r\n");
+            const std::string content = i == 0 ? body : i == 1 ? "not found" : "partial";
+            // last one: more than any disk can hold
+            const std::string length = i == 2 ? std::to_string(uint64_t(1) << 50) : std::to_string(content.size());
+            boost::system::error_code ec;
+            boost::asio::write(socket, boost::asio::buffer(std::string(i == 1 ? "HTTP/1.1 404 Not Found" : "HTTP/1.1 200 OK") +
+                                                           "\r\nContent-Length: " + length +
+                                                           "\r\nConnection: close\r\n\r\n" + content),
+                               ec);
+        }
+    });
+
+    const std::string path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+    const std::string url = "http://127.0.0.1:" + std::to_string(port);
+    httb::client client;
+    uint64_t loaded = 0, total = 0;
+    httb::response resp = client.download_blocking(httb::request(url + "/file"), path, [&loaded, &total](uint64_t l, uint64_t t, double) {
+        loaded = l;
+        total = t;
+    });
+    ASSERT_EQ(200, resp.code);
+    ASSERT_EQ(0, resp.get_body_size());
+    ASSERT_EQ(body.size(), loaded);
+    ASSERT_EQ(body.size(), total);
+    ASSERT_EQ(body.size(), boost::filesystem::file_size(path));
+    std::ifstream in(path, std::ios::binary);
+    const std::string written((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    ASSERT_TRUE(written == body);
+    boost::filesystem::remove(path);
+
+    // error response is not written to file
+    resp = client.download_blocking(httb::request(url + "/missing"), path);
+    ASSERT_EQ(404, resp.code);
+    ASSERT_STREQ("not found", resp.get_body_c());
+    ASSERT_FALSE(boost::filesystem::exists(path));
+
+    // space can't be reserved: download fails and file is removed
+    resp = client.download_blocking(httb::request(url + "/huge"), path);
+    server.join();
+    ASSERT_TRUE(resp.is_internal_error());
+    ASSERT_FALSE(boost::filesystem::exists(path));
+}
+
+TEST(HttpClientTest, TestStreamMultipartUpload) {
+    const std::string path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+    std::string fileData(3 * 1024 * 1024 + 777, '\0');
+    for (size_t i = 0; i < fileData.size(); i++) {
+        fileData[i] = static_cast<char>(i * 31 % 251);
+    }
+    {
+        std::ofstream out(path, std::ios::binary);
+        out.write(fileData.data(), fileData.size());
+    }
+
+    boost::asio::io_context serverCtx;
+    boost::asio::ip::tcp::acceptor acceptor(serverCtx, boost::asio::ip::tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0));
+    const uint16_t port = acceptor.local_endpoint().port();
+    std::vector<std::string> headers, bodies;
+    std::thread server([&acceptor, &serverCtx, &headers, &bodies]() {
+        for (int i = 0; i < 2; i++) {
+            boost::asio::ip::tcp::socket socket(serverCtx);
+            acceptor.accept(socket);
+            boost::asio::streambuf buffer;
+            const size_t headerSize = boost::asio::read_until(socket, buffer, "\r\n\r\n");
+            std::string data(boost::asio::buffers_begin(buffer.data()), boost::asio::buffers_end(buffer.data()));
+            std::string header = data.substr(0, headerSize);
+            const size_t lengthPos = header.find("Content-Length: ");
+            const size_t length = lengthPos == std::string::npos ? 0 : std::stoul(header.substr(lengthPos + 16));
+            std::string body = data.substr(headerSize);
+            if (body.size() < length) {
+                std::string rest(length - body.size(), '\0');
+                boost::asio::read(socket, boost::asio::buffer(&rest[0], rest.size()));
+                body += rest;
+            }
+            headers.push_back(std::move(header));
+            bodies.push_back(std::move(body));
+            boost::asio::write(socket, boost::asio::buffer(std::string("HTTP/1.1 200 OK\r\nContent-Length: 2\r\nConnection: close\r\n\r\nok")));
+        }
+    });
+
+    httb::body_multipart_stream multipart;
+    multipart.add_entry({"field", "value"});
+    multipart.add_entry({"file", httb::file_path_entry{"data.bin", "application/octet-stream", path}});
+
+    httb::request req("http://127.0.0.1:" + std::to_string(port) + "/upload", httb::request::method::post);
+    req.set_body(multipart);
+    ASSERT_FALSE(req.get_body_source() == nullptr);
+    // nothing is loaded into request
+    ASSERT_EQ(0, req.get_body_size());
+
+    const std::string expected = multipart.build(&req);
+    ASSERT_NE(std::string::npos, expected.find(fileData));
+    ASSERT_EQ(std::to_string(expected.size()), req.get_header_value("Content-Length"));
+
+    httb::client client;
+    httb::response resp = client.execute_blocking(req);
+    ASSERT_EQ(200, resp.code);
+
+    boost::asio::io_context ioc;
+    client.execute_in_context(ioc, req, [&resp](httb::response result) {
+        resp = std::move(result);
+    });
+    ioc.run();
+    server.join();
+    boost::filesystem::remove(path);
+    ASSERT_EQ(200, resp.code);
+
+    ASSERT_EQ(2, bodies.size());
+    for (size_t i = 0; i < bodies.size(); i++) {
+        ASSERT_NE(std::string::npos, headers[i].find("multipart/form-data; boundary=" + multipart.boundaryName));
+        ASSERT_TRUE(bodies[i] == expected);
+    }
+    ASSERT_EQ(0, expected.find("--" + multipart.boundaryName + "\r\nContent-Disposition: form-data; name=\"field\""));
+    ASSERT_EQ(expected.size() - multipart.boundaryName.size() - 6, expected.rfind("--" + multipart.boundaryName + "--\r\n"));
+}
+
+TEST(HttpClientTest, TestFileBodyUpload) {
+    const std::string path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+    // larger than socket buffers: sendfile has to wait for slow reader
+    std::string fileData(8 * 1024 * 1024 + 3, '\0');
+    for (size_t i = 0; i < fileData.size(); i++) {
+        fileData[i] = static_cast<char>(i * 17 % 253);
+    }
+    {
+        std::ofstream out(path, std::ios::binary);
+        out.write(fileData.data(), fileData.size());
+    }
+
+    boost::asio::io_context serverCtx;
+    boost::asio::ip::tcp::acceptor acceptor(serverCtx, boost::asio::ip::tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0));
+    const uint16_t port = acceptor.local_endpoint().port();
+    std::vector<std::string> headers, bodies;
+    std::thread server([&acceptor, &serverCtx, &headers, &bodies]() {
+        for (int i = 0; i < 2; i++) {
+            boost::asio::ip::tcp::socket socket(serverCtx);
+            acceptor.accept(socket);
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            boost::asio::streambuf buffer;
+            const size_t headerSize = boost::asio::read_until(socket, buffer, "\r\n\r\n");
+            std::string data(boost::asio::buffers_begin(buffer.data()), boost::asio::buffers_end(buffer.data()));
+            std::string header = data.substr(0, headerSize);
+            const size_t lengthPos = header.find("Content-Length: ");
+            const size_t length = lengthPos == std::string::npos ? 0 : std::stoul(header.substr(lengthPos + 16));
+            std::string body = data.substr(headerSize);
+            if (body.size() < length) {
+                std::string rest(length - body.size(), '\0');
+                boost::asio::read(socket, boost::asio::buffer(&rest[0], rest.size()));
+                body += rest;
+            }
+            headers.push_back(std::move(header));
+            bodies.push_back(std::move(body));
+            boost::asio::write(socket, boost::asio::buffer(std::string("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok")));
+        }
+    });
+
+    httb::request req("http://127.0.0.1:" + std::to_string(port) + "/ingest", httb::request::method::put);
+    req.set_body(httb::body_file(path));
+    ASSERT_EQ(0, req.get_body_size());
+    ASSERT_EQ(std::to_string(fileData.size()), req.get_header_value("Content-Length"));
+
+    httb::client client;
+    // keep-alive connection of blocking request is not used by async one: they run in different contexts
+    httb::response resp = client.execute_blocking(req);
+    ASSERT_EQ(200, resp.code);
+    ASSERT_STREQ("ok", resp.get_body_c());
+
+    boost::asio::io_context ioc;
+    client.execute_in_context(ioc, req, [&resp](httb::response result) {
+        resp = std::move(result);
+    });
+    ioc.run();
+    server.join();
+    boost::filesystem::remove(path);
+    ASSERT_EQ(200, resp.code);
+    ASSERT_STREQ("ok", resp.get_body_c());
+
+    ASSERT_EQ(2, bodies.size());
+    for (size_t i = 0; i < bodies.size(); i++) {
+        ASSERT_NE(std::string::npos, headers[i].find("PUT /ingest HTTP/1.1\r\n"));
+        ASSERT_NE(std::string::npos, headers[i].find("Content-Type: application/octet-stream\r\n"));
+        ASSERT_TRUE(bodies[i] == fileData);
+    }
+}
+
+TEST(HttpClientTest, TestStreamRequestBody) {
+    // ~15MB of NDJSON, larger than socket buffers: producer has to wait for slow reader
+    const size_t lines = 1000000;
+    const size_t linesPerPiece = 1000;
+    auto makeLine = [](size_t i) {
+        return "{\"id\":" + std::to_string(i) + "}\n";
+    };
+    std::string expected;
+    for (size_t i = 0; i < lines; i++) {
+        expected += makeLine(i);
+    }
+
+    std::atomic<size_t> produced(0);
+    httb::body_stream body([&produced, &makeLine, lines, linesPerPiece]() {
+        produced = 0;
+        auto next = std::make_shared<size_t>(0);
+        return [&produced, &makeLine, next, lines, linesPerPiece](std::string& out, boost::system::error_code&) {
+            for (size_t i = 0; i < linesPerPiece && *next < lines; i++) {
+                out += makeLine((*next)++);
+            }
+            produced += out.size();
+            return *next < lines;
+        };
+    },
+                           "application/x-ndjson");
+
+    boost::asio::io_context serverCtx;
+    boost::asio::ip::tcp::acceptor acceptor(serverCtx, boost::asio::ip::tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0));
+    const uint16_t port = acceptor.local_endpoint().port();
+    std::vector<boost::beast::http::request<boost::beast::http::string_body>> requests;
+    std::vector<size_t> producedBeforeRead;
+    std::thread server([&acceptor, &serverCtx, &requests, &producedBeforeRead, &produced]() {
+        namespace http = boost::beast::http;
+        for (int i = 0; i < 2; i++) {
+            boost::asio::ip::tcp::socket socket(serverCtx);
+            acceptor.accept(socket);
+            std::this_thread::sleep_for(std::chrono::milliseconds(300));
+            producedBeforeRead.push_back(produced.load());
+
+            boost::beast::flat_buffer buffer;
+            http::request_parser<http::string_body> parser;
+            parser.body_limit(64 * 1024 * 1024);
+            http::read(socket, buffer, parser);
+            requests.push_back(parser.release());
+            boost::asio::write(socket, boost::asio::buffer(std::string("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok")));
+        }
+    });
+
+    httb::request req("http://127.0.0.1:" + std::to_string(port) + "/export", httb::request::method::post);
+    req.set_body(body);
+    ASSERT_FALSE(req.has_header("Content-Length"));
+
+    httb::client client;
+    httb::response resp = client.execute_blocking(req);
+    ASSERT_EQ(200, resp.code);
+
+    boost::asio::io_context ioc;
+    client.execute_in_context(ioc, req, [&resp](httb::response result) {
+        resp = std::move(result);
+    });
+    ioc.run();
+    server.join();
+    ASSERT_EQ(200, resp.code);
+    ASSERT_STREQ("ok", resp.get_body_c());
+
+    ASSERT_EQ(2, requests.size());
+    for (size_t i = 0; i < requests.size(); i++) {
+        ASSERT_TRUE(requests[i].chunked());
+        ASSERT_EQ("application/x-ndjson", requests[i][boost::beast::http::field::content_type]);
+        ASSERT_TRUE(requests[i].body() == expected);
+        // producer has been paused while server was not reading
+        ASSERT_LT(producedBeforeRead[i], expected.size());
+    }
+}
+
 TEST(HttpClientTest, TestSimpleAsyncGet) {
     httb::request req("http://127.0.0.1:9000/simple-server.php/get");
     httb::request req2("http://127.0.0.1:9000/simple-server.php/get");